@@ -1206,7 +1206,7 @@ void MathPlotConfigDialog::OnbApplyClick(wxCommandEvent &WXUNUSED(event))
           m_plot->Fit();
         }
         else
-          m_plot->Refresh();
+          m_plot->InvalidateFrame();
       }
       break;
     default:
@@ -55,10 +55,17 @@
 #include <wx/dcbuffer.h>
 #include <wx/filename.h>
 
+#include <algorithm>
 #include <cmath>
+#include <sstream>
 #include <cstdio> // used only for debug
+#include <exception>
 #include <ctime>  // used for representation of x axes involving date
 
+#if wxUSE_GRAPHICS_CONTEXT
+#include <wx/graphics.h>
+#endif
+
 // If we want icon on the popup menu
 #define USE_ICON
 #ifdef USE_ICON
@@ -168,6 +175,16 @@ double mpWindow::zoomIncrementalFactor = 1.5;
     { delete(ptr);  \
       (ptr) = NULL; }}
 
+// Limit of the pixel coordinates, far enough to keep the slope of the lines
+#define mpMAX_COORD  1e9
+
+// Clamp a coordinate in pixels, so the cast to wxCoord is always defined. A NaN gives the lowest value.
+static inline double ClampCoord(double v)
+{
+  v = (v > -mpMAX_COORD) ? v : -mpMAX_COORD;
+  return (v < mpMAX_COORD) ? v : mpMAX_COORD;
+}
+
 //-----------------------------------------------------------------------------
 // Date time conversion
 //-----------------------------------------------------------------------------
@@ -191,6 +208,340 @@ bool DoubleToTimeStruct(double val, unsigned int timeConv, struct tm *timestruct
   return false;
 }
 
+//-----------------------------------------------------------------------------
+// mpTimeConverter
+//-----------------------------------------------------------------------------
+
+#define mpNS_PER_SECOND ((wxInt64)1000000000)
+#define mpNS_PER_DAY    (86400 * mpNS_PER_SECOND)
+
+// Division rounded toward minus infinity, for the timestamps before 1970
+static wxInt64 FloorDiv(wxInt64 a, wxInt64 b)
+{
+  wxInt64 q = a / b;
+  return ((a % b != 0) && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+// The algorithms of the civil calendar work on eras of 400 years, starting on March 1st
+wxInt64 mpTimeConverter::DaysFromCivil(int year, int month, int day)
+{
+  wxInt64 y = year - ((month <= 2) ? 1 : 0);
+  wxInt64 era = FloorDiv(y, 400);
+  wxInt64 yoe = y - era * 400;                                              // [0, 399]
+  wxInt64 doy = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+  wxInt64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                      // [0, 146096]
+  return era * 146097 + doe - 719468;
+}
+
+void mpTimeConverter::CivilFromDays(wxInt64 days, int *year, int *month, int *day)
+{
+  days += 719468;
+  wxInt64 era = FloorDiv(days, 146097);
+  wxInt64 doe = days - era * 146097;
+  wxInt64 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  wxInt64 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  wxInt64 mp = (5 * doy + 2) / 153;
+  *day = (int)(doy - (153 * mp + 2) / 5 + 1);
+  *month = (int)((mp < 10) ? mp + 3 : mp - 9);
+  *year = (int)(yoe + era * 400 + ((*month <= 2) ? 1 : 0));
+}
+
+void mpTimeConverter::ToCalendar(wxInt64 timestamp, mpCalendarTime *time)
+{
+  wxInt64 day = FloorDiv(timestamp, mpNS_PER_DAY);
+  if (day != m_day)
+  {
+    m_day = day;
+    CivilFromDays(day, &m_year, &m_month, &m_dayOfMonth);
+  }
+  time->year = m_year;
+  time->month = m_month;
+  time->day = m_dayOfMonth;
+
+  wxInt64 ns = timestamp - day * mpNS_PER_DAY;
+  wxInt64 seconds = ns / mpNS_PER_SECOND;
+  time->nanosecond = (int)(ns - seconds * mpNS_PER_SECOND);
+  time->hour = (int)(seconds / 3600);
+  time->minute = (int)((seconds / 60) % 60);
+  time->second = (int)(seconds % 60);
+}
+
+//-----------------------------------------------------------------------------
+// mpRangeMinMax
+//-----------------------------------------------------------------------------
+
+void mpRangeMinMax::Build(const std::vector<double> &values)
+{
+  size_t capacity = 1;
+  while (capacity < values.size())
+    capacity <<= 1;
+  Rebuild(values, capacity);
+}
+
+void mpRangeMinMax::Rebuild(const std::vector<double> &values, size_t capacity)
+{
+  m_capacity = capacity;
+  m_size = values.size();
+  m_min.assign(2 * m_capacity, 1e+308);
+  m_max.assign(2 * m_capacity, -1e+308);
+  for (size_t i = 0; i < m_size; i++)
+    m_min[m_capacity + i] = m_max[m_capacity + i] = values[i];
+  for (size_t i = m_capacity - 1; i > 0; i--)
+  {
+    m_min[i] = wxMin(m_min[2 * i], m_min[2 * i + 1]);
+    m_max[i] = wxMax(m_max[2 * i], m_max[2 * i + 1]);
+  }
+}
+
+void mpRangeMinMax::Append(double value)
+{
+  // Double the capacity when full, so append is amortized
+  if (m_size == m_capacity)
+  {
+    std::vector<double> values(m_min.begin() + m_capacity, m_min.begin() + m_capacity + m_size);
+    Rebuild(values, (m_capacity == 0) ? 16 : 2 * m_capacity);
+  }
+
+  size_t i = m_capacity + m_size;
+  m_min[i] = m_max[i] = value;
+  m_size++;
+  for (i >>= 1; i > 0; i >>= 1)
+  {
+    m_min[i] = wxMin(m_min[2 * i], m_min[2 * i + 1]);
+    m_max[i] = wxMax(m_max[2 * i], m_max[2 * i + 1]);
+  }
+}
+
+void mpRangeMinMax::Clear()
+{
+  m_size = 0;
+  m_capacity = 0;
+  m_min.clear();
+  m_max.clear();
+}
+
+bool mpRangeMinMax::Query(size_t first, size_t last, double *min, double *max) const
+{
+  if (last > m_size)
+    last = m_size;
+  if (first >= last)
+    return false;
+
+  double vmin = 1e+308, vmax = -1e+308;
+  for (size_t l = first + m_capacity, r = last + m_capacity; l < r; l >>= 1, r >>= 1)
+  {
+    if (l & 1)
+    {
+      vmin = wxMin(vmin, m_min[l]);
+      vmax = wxMax(vmax, m_max[l]);
+      l++;
+    }
+    if (r & 1)
+    {
+      r--;
+      vmin = wxMin(vmin, m_min[r]);
+      vmax = wxMax(vmax, m_max[r]);
+    }
+  }
+  *min = vmin;
+  *max = vmax;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// mpThreadPool
+//-----------------------------------------------------------------------------
+
+mpThreadPool::mpThreadPool(unsigned int threads)
+{
+  m_stop = false;
+  for (unsigned int i = 0; i < threads; i++)
+    m_threads.push_back(std::thread(&mpThreadPool::Worker, this));
+}
+
+mpThreadPool::~mpThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (size_t i = 0; i < m_threads.size(); i++)
+    m_threads[i].join();
+}
+
+// The shared pool, deleted by mpThreadPool::Shutdown
+static mpThreadPool *mpSharedPool = NULL;
+static std::mutex mpSharedPoolMutex;
+
+mpThreadPool& mpThreadPool::Get()
+{
+  std::lock_guard<std::mutex> lock(mpSharedPoolMutex);
+  // The calling thread is also used
+  if (mpSharedPool == NULL)
+    mpSharedPool = new mpThreadPool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+  return *mpSharedPool;
+}
+
+void mpThreadPool::Shutdown()
+{
+  std::lock_guard<std::mutex> lock(mpSharedPoolMutex);
+  DeleteAndNull(mpSharedPool);
+}
+
+/**
+ * Module to shut down the shared thread pool when the wx library is cleaned up,
+ * before the static objects are destroyed.
+ */
+class mpThreadPoolModule : public wxModule
+{
+  public:
+    mpThreadPoolModule()
+    {
+      ;
+    }
+    virtual bool OnInit()
+    {
+      return true;
+    }
+    virtual void OnExit()
+    {
+      mpThreadPool::Shutdown();
+    }
+
+  private:
+    DECLARE_DYNAMIC_CLASS(mpThreadPoolModule)
+};
+
+IMPLEMENT_DYNAMIC_CLASS(mpThreadPoolModule, wxModule)
+
+void mpThreadPool::Worker()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+      if (m_tasks.empty())
+        return;
+      task = m_tasks.front();
+      m_tasks.pop_front();
+    }
+    // The chunks catch their exceptions and count themselves, see Run
+    task();
+  }
+}
+
+void mpThreadPool::Run(size_t n, size_t minChunk, const std::function<void(size_t, size_t)> &task)
+{
+  size_t chunks = (minChunk > 0) ? n / minChunk : n;
+  if (chunks > m_threads.size() + 1)
+    chunks = m_threads.size() + 1;
+  if (chunks <= 1)
+  {
+    if (n > 0)
+      task(0, n);
+    return;
+  }
+
+  // State of this call, shared with its chunks only, so several calls can run at the same time.
+  // It lives until all the chunks are finished, since Run always waits for them, even on an exception.
+  size_t pending = 0;
+  std::exception_ptr error;
+
+  // The first chunk is executed by the calling thread
+  size_t size = (n + chunks - 1) / chunks;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t first = size; first < n; first += size)
+    {
+      size_t last = wxMin(first + size, n);
+      m_tasks.push_back([this, &task, &pending, &error, first, last]
+      {
+        std::exception_ptr chunkError;
+        try
+        {
+          task(first, last);
+        }
+        catch (...)
+        {
+          chunkError = std::current_exception();
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (chunkError && !error)
+            error = chunkError;
+          pending--;
+        }
+        m_done.notify_all();
+      });
+      pending++;
+    }
+  }
+  m_wake.notify_all();
+  std::exception_ptr callerError;
+  try
+  {
+    task(0, size);
+  }
+  catch (...)
+  {
+    callerError = std::current_exception();
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [&pending] { return pending == 0; });
+  lock.unlock();
+
+  // The first exception is given back to the caller
+  if (callerError)
+    std::rethrow_exception(callerError);
+  if (error)
+    std::rethrow_exception(error);
+}
+
+//-----------------------------------------------------------------------------
+// mpBackingStore
+//-----------------------------------------------------------------------------
+
+void mpBackingStore::Save(wxDC &dc, const wxRect &rect)
+{
+  m_saved = false;
+  if ((rect.width <= 0) || (rect.height <= 0))
+    return;
+
+  // Grow the bitmap only if needed
+  if (!m_bmp.IsOk() || (m_bmp.GetWidth() < rect.width) || (m_bmp.GetHeight() < rect.height))
+  {
+    int width = m_bmp.IsOk() ? wxMax(m_bmp.GetWidth(), rect.width) : rect.width;
+    int height = m_bmp.IsOk() ? wxMax(m_bmp.GetHeight(), rect.height) : rect.height;
+    m_dc.SelectObject(wxNullBitmap);
+    m_bmp.Create(width, height, dc);
+    m_dc.SelectObject(m_bmp);
+  }
+
+  m_dc.Blit(0, 0, rect.width, rect.height, &dc, rect.x, rect.y);
+  m_rect = rect;
+  m_saved = true;
+}
+
+void mpBackingStore::Restore(wxDC &dc)
+{
+  if (m_saved)
+  {
+    dc.Blit(m_rect.x, m_rect.y, m_rect.width, m_rect.height, &m_dc, 0, 0);
+    m_saved = false;
+  }
+}
+
+void mpBackingStore::Release()
+{
+  m_dc.SelectObject(wxNullBitmap);
+  m_bmp = wxNullBitmap;
+  m_saved = false;
+}
+
 //-----------------------------------------------------------------------------
 // mpLayer
 //-----------------------------------------------------------------------------
@@ -215,6 +566,31 @@ mpLayer::mpLayer() :
   m_CanDelete = true;
   m_busy = false;
   m_ZIndex = mpZIndex_BACKGROUND;
+  m_win = NULL;
+}
+
+void mpLayer::SetName(const wxString &name)
+{
+  wxString oldName = m_name;
+  m_name = name;
+  // Keep the index of the window up to date
+  if (m_win)
+    m_win->UpdateLayerName(this, oldName);
+}
+
+void mpLayer::BBoxChanged()
+{
+  if (m_win)
+    m_win->LayerBBoxChanged(this);
+}
+
+void mpLayer::SetZIndex(mpLayerZOrder ZIndex)
+{
+  mpLayerZOrder oldZIndex = m_ZIndex;
+  m_ZIndex = ZIndex;
+  // Keep the Z-Order lists of the window up to date
+  if (m_win)
+    m_win->UpdateLayerZIndex(this, oldZIndex);
 }
 
 void mpLayer::GetBBox(mpFloatRect *m_bound)
@@ -456,7 +832,6 @@ mpInfoCoords::mpInfoCoords() :
   m_labelType = mpX_NORMAL;
   m_timeConv = 0;
   m_mouseX = m_mouseY = 0;
-  m_coord_bmp = NULL;
   m_location = mpMarginBottomRight;
   wxBrush coord(wxColour(232, 232, 232), wxBRUSHSTYLE_SOLID);
   SetBrush(coord);
@@ -471,7 +846,6 @@ mpInfoCoords::mpInfoCoords(mpLocation location) :
   m_labelType = mpX_NORMAL;
   m_timeConv = 0;
   m_mouseX = m_mouseY = 0;
-  m_coord_bmp = NULL;
   m_location = location;
   m_series_coord = false;
   wxBrush coord(wxColour(232, 232, 232), wxBRUSHSTYLE_SOLID);
@@ -484,18 +858,12 @@ mpInfoCoords::mpInfoCoords(wxRect rect, const wxBrush &brush, mpLocation locatio
   m_labelType = mpX_NORMAL;
   m_timeConv = 0;
   m_mouseX = m_mouseY = 0;
-  m_coord_bmp = NULL;
   m_series_coord = false;
 }
 
-mpInfoCoords::~mpInfoCoords()
-{
-  DeleteAndNull(m_coord_bmp);
-}
 void mpInfoCoords::SetVisible(bool show)
 {
   m_visible = show;
-  DeleteAndNull(m_coord_bmp);
 }
 
 void mpInfoCoords::UpdateInfo(mpWindow &w, wxEvent &event)
@@ -567,6 +935,14 @@ void mpInfoCoords::UpdateInfo(mpWindow &w, wxEvent &event)
         m_content.Printf(_T("x = %02.0f:%02.0f:%02.0f"), sign * hh, mm, floor(ss));
         break;
       }
+      case mpX_TIMESTAMP:
+      {
+        // The time origin and the conversion are those of the X axis
+        mpScaleX* axis = m_win->GetLayerXAxis();
+        if (axis)
+          m_content.Printf(_T("x = %s"), axis->FormatTimestamp(axis->XToTimestamp(xVal)));
+        break;
+      }
       default:
         ;
     }
@@ -592,22 +968,25 @@ void mpInfoCoords::UpdateInfo(mpWindow &w, wxEvent &event)
 void mpInfoCoords::DoPlot(wxDC &dc, mpWindow &w)
 {
   if (m_content.IsEmpty())
-  {
-    ErasePlot(dc, w);
     return;
-  }
 
+  LayoutBox(dc, w);
+  DrawBox(dc);
+}
+
+void mpInfoCoords::LayoutBox(wxDC &dc, mpWindow &w)
+{
   int textX = 0, textY = 0;
   int width = 0, height = 0;
   int offset = (m_series_coord) ? LEGEND_LINEWIDTH : 0;
 
+  dc.SetFont(m_font);
 // Should be work on Windows and Linux. If no, use GetTextExtent for Linux
   dc.GetMultiLineTextExtent(m_content, &textX, &textY);
   if (width < textX + MARGIN_COORD_X2 + offset)
     width = textX + MARGIN_COORD_X2 + offset;
   if (height < textY + MARGIN_COORD_X2)
     height = textY + MARGIN_COORD_X2;
-  textY /= 2;
 
   SetInfoRectangle(w, width, height);
   if (m_location == mpCursor)
@@ -619,30 +998,16 @@ void mpInfoCoords::DoPlot(wxDC &dc, mpWindow &w)
     if (m_dim.y + m_dim.height > w.GetScreenY())
       m_dim.y = m_mouseY - m_dim.height - 5;
   }
+}
 
-  // Don't use stored bitmap when we repaint all
-  if (w.IsRepainting())
-    DeleteAndNull(m_coord_bmp);
-
-  // First : restaure stored bitmap
-  if (m_coord_bmp)
-  {
-    wxMemoryDC m_coord_dc(&dc);
-    m_coord_dc.SelectObject(*m_coord_bmp);
-    dc.Blit(m_oldDim.x, m_oldDim.y, m_oldDim.width, m_oldDim.height, &m_coord_dc, 0, 0);
-    m_coord_dc.SelectObject(wxNullBitmap);
-    DeleteAndNull(m_coord_bmp);
-  }
+void mpInfoCoords::DrawBox(wxDC &dc)
+{
+  int textX = 0, textY = 0;
+  int offset = (m_series_coord) ? LEGEND_LINEWIDTH : 0;
 
-  // Second : store new bitmap
-  m_coord_bmp = new wxBitmap(m_dim.width, m_dim.height, dc);
-  wxMemoryDC m_coord_dc(&dc);
-  m_coord_dc.SelectObject(*m_coord_bmp);
-  m_coord_dc.Blit(0, 0, m_dim.width, m_dim.height, &dc, m_dim.x, m_dim.y);
-  m_coord_dc.SelectObject(wxNullBitmap);
-  m_oldDim = m_dim;
+  dc.GetMultiLineTextExtent(m_content, &textX, &textY);
+  textY /= 2;
 
-  // Third : draw the coordinate
   dc.DrawRectangle(m_dim);
   dc.DrawText(m_content, m_dim.x + MARGIN_COORD + offset, m_dim.y + MARGIN_COORD);
   if (m_series_coord)
@@ -656,16 +1021,24 @@ void mpInfoCoords::DoPlot(wxDC &dc, mpWindow &w)
   }
 }
 
-void mpInfoCoords::ErasePlot(wxDC &dc, mpWindow &WXUNUSED(w))
+void mpInfoCoords::ErasePlot(wxDC &WXUNUSED(dc), mpWindow &WXUNUSED(w))
 {
-  if (m_coord_bmp)
-  {
-    wxMemoryDC m_coord_dc(&dc);
-    m_coord_dc.SelectObject(*m_coord_bmp);
-    dc.Blit(m_oldDim.x, m_oldDim.y, m_oldDim.width, m_oldDim.height, &m_coord_dc, 0, 0);
-    m_coord_dc.SelectObject(wxNullBitmap);
-    DeleteAndNull(m_coord_bmp);
-  }
+  ShowOverlay(false);
+}
+
+void mpInfoCoords::GetOverlayRects(wxDC &dc, mpWindow &w, std::vector<wxRect> &rects)
+{
+  if ((!m_visible) || m_content.IsEmpty())
+    return;
+
+  LayoutBox(dc, w);
+  rects.push_back(m_dim);
+}
+
+void mpInfoCoords::DrawOverlay(wxDC &dc, mpWindow &WXUNUSED(w))
+{
+  UpdateContext(dc);
+  DrawBox(dc);
 }
 
 //-----------------------------------------------------------------------------
@@ -854,6 +1227,14 @@ mpFunction::mpFunction(const wxString &name, bool useY2Axis)
   m_step = 1;
   m_UseY2Axis = useY2Axis;
   m_ZIndex = mpZIndex_PLOT;
+  m_adaptive = false;
+  m_adaptiveBudget = 4096;
+  m_cached = false;
+  m_parallel = false;
+  m_cacheValid = false;
+  m_cacheScale = 0;
+  m_cacheFirst = 0;
+  m_cacheStride = 1;
 }
 
 void mpFunction::DrawSymbol(wxDC &dc, wxCoord x, wxCoord y)
@@ -899,6 +1280,187 @@ void mpFunction::DrawSymbol(wxDC &dc, wxCoord x, wxCoord y)
   }
 }
 
+// Minimum number of samples evaluated by a thread
+#define mpPARALLEL_MIN_CHUNK  32
+
+void mpFunction::DoEvaluate(const double *args, double *values, size_t n)
+{
+  if (m_parallel)
+    mpThreadPool::Get().Run(n, mpPARALLEL_MIN_CHUNK, [this, args, values](size_t first, size_t last)
+        {
+          DoGetValues(args + first, values + first, last - first);
+        });
+  else
+    DoGetValues(args, values, n);
+}
+
+void mpFunction::DoGetCachedValues(double origin, double scale, bool reversed, wxCoord start, size_t n)
+{
+  // Grid index of the pixel 0, and of the first sample
+  wxInt64 base = (wxInt64)floor(origin * scale + 0.5);
+  wxInt64 stride = reversed ? -(wxInt64)m_step : (wxInt64)m_step;
+  wxInt64 first = reversed ? base - start : base + start;
+  bool valid = m_cacheValid && (m_cacheScale == scale) && (m_cacheStride == stride);
+
+  m_samplesArg.resize(n);
+  m_samplesValue.resize(n);
+  m_cacheMissing.clear();
+  for (size_t k = 0; k < n; k++)
+  {
+    wxInt64 index = first + (wxInt64)k * stride;
+    m_samplesArg[k] = index / scale;
+
+    wxInt64 offset = index - m_cacheFirst;
+    wxInt64 j = offset / stride;
+    if (valid && (offset % stride == 0) && (j >= 0) && (j < (wxInt64)m_cacheValues.size()))
+      m_samplesValue[k] = m_cacheValues[j];
+    else
+      m_cacheMissing.push_back(k);
+  }
+
+  // Evaluate the missing samples in one call
+  size_t count = m_cacheMissing.size();
+  if (count > 0)
+  {
+    m_cacheMissingArg.resize(count);
+    m_cacheMissingValue.resize(count);
+    for (size_t j = 0; j < count; j++)
+      m_cacheMissingArg[j] = m_samplesArg[m_cacheMissing[j]];
+    DoEvaluate(&m_cacheMissingArg[0], &m_cacheMissingValue[0], count);
+    for (size_t j = 0; j < count; j++)
+      m_samplesValue[m_cacheMissing[j]] = m_cacheMissingValue[j];
+  }
+
+  // The cache now holds the samples of this frame
+  m_cacheValues.assign(m_samplesValue.begin(), m_samplesValue.begin() + n);
+  m_cacheFirst = first;
+  m_cacheStride = stride;
+  m_cacheScale = scale;
+  m_cacheValid = true;
+}
+
+// Adaptive sampling: spacing of the initial grid (in steps), tolerance and smallest interval (in pixels)
+#define mpADAPTIVE_GRID       8
+#define mpADAPTIVE_TOLERANCE  0.5
+#define mpADAPTIVE_MIN_WIDTH  1
+// Ratio between the change of slope and the slope beyond which a sample is refined
+#define mpADAPTIVE_SLOPE_RATIO 2
+
+size_t mpFunction::DoAdaptiveSampling(mpWindow &w, wxCoord start, wxCoord end)
+{
+  m_adaptivePos.clear();
+  m_adaptiveValue.clear();
+  if (end - 1 <= start)
+    return 0;
+
+  // Initial coarse grid, last pixel included
+  double last = end - 1;
+  double grid = (double)mpADAPTIVE_GRID * m_step;
+  size_t n = (size_t)ceil((last - start) / grid) + 1;
+  if (n > m_adaptiveBudget)
+  {
+    n = m_adaptiveBudget;
+    grid = (last - start) / (n - 1);
+  }
+  m_adaptivePos.resize(n);
+  m_adaptiveValue.resize(n);
+  for (size_t k = 0; k < n - 1; k++)
+    m_adaptivePos[k] = start + k * grid;
+  m_adaptivePos[n - 1] = last;
+  DoGetSamples(w, &m_adaptivePos[0], &m_adaptiveValue[0], n);
+  size_t evaluations = n;
+
+  // Intervals to subdivide, by the index of their first sample
+  std::vector<size_t> split(n - 1);
+  for (size_t k = 0; k < n - 1; k++)
+    split[k] = k;
+
+  std::vector<double> midPos, midValue, newPos, newValue;
+  std::vector<size_t> newSplit;
+  std::vector<bool> refine;
+  while (!split.empty() && (evaluations < m_adaptiveBudget))
+  {
+    // Evaluate the middle of the intervals in one call
+    size_t count = wxMin(split.size(), (size_t)(m_adaptiveBudget - evaluations));
+    midPos.resize(count);
+    midValue.resize(count);
+    for (size_t j = 0; j < count; j++)
+      midPos[j] = (m_adaptivePos[split[j]] + m_adaptivePos[split[j] + 1]) / 2;
+    DoGetSamples(w, &midPos[0], &midValue[0], count);
+    evaluations += count;
+
+    // Insert the middles and mark the intervals where the curve is not linear
+    newPos.clear();
+    newValue.clear();
+    refine.clear();
+    size_t j = 0;
+    for (size_t k = 0; k < m_adaptivePos.size(); k++)
+    {
+      newPos.push_back(m_adaptivePos[k]);
+      newValue.push_back(m_adaptiveValue[k]);
+      if ((j < count) && (split[j] == k))
+      {
+        double linear = (m_adaptiveValue[k] + m_adaptiveValue[k + 1]) / 2;
+        bool curved = fabs(midValue[j] - linear) > mpADAPTIVE_TOLERANCE;
+        newPos.push_back(midPos[j]);
+        newValue.push_back(midValue[j]);
+        refine.push_back(curved);
+        refine.push_back(curved);
+        j++;
+      }
+      else if (k + 1 < m_adaptivePos.size())
+        refine.push_back(false);
+    }
+
+    // A narrow peak may hide between two samples where the middle looks linear :
+    // also refine around the samples where the slope changes sign or size sharply
+    for (size_t k = 1; k + 1 < newPos.size(); k++)
+    {
+      double before = (newValue[k] - newValue[k - 1]) / (newPos[k] - newPos[k - 1]);
+      double after = (newValue[k + 1] - newValue[k]) / (newPos[k + 1] - newPos[k]);
+      double change = fabs(after - before);
+      if ((change > mpADAPTIVE_TOLERANCE)
+          && ((before * after <= 0) || (change > mpADAPTIVE_SLOPE_RATIO * wxMin(fabs(before), fabs(after)))))
+        refine[k - 1] = refine[k] = true;
+    }
+
+    // Keep the intervals to refine that are not too small
+    newSplit.clear();
+    for (size_t k = 0; k < refine.size(); k++)
+    {
+      if (refine[k] && ((newPos[k + 1] - newPos[k]) / 2 >= mpADAPTIVE_MIN_WIDTH))
+        newSplit.push_back(k);
+    }
+    m_adaptivePos.swap(newPos);
+    m_adaptiveValue.swap(newValue);
+    split.swap(newSplit);
+  }
+  return m_adaptivePos.size();
+}
+
+void mpFunction::DrawAdaptiveSamples(wxDC &dc, size_t n, bool horizontal)
+{
+  if (n == 0)
+    return;
+
+  wxCoord pos0 = (wxCoord)floor(m_adaptivePos[0] + 0.5);
+  wxCoord value0 = (wxCoord)m_adaptiveValue[0];
+  for (size_t k = 1; k < n; k++)
+  {
+    wxCoord pos1 = (wxCoord)floor(m_adaptivePos[k] + 0.5);
+    wxCoord value1 = (wxCoord)m_adaptiveValue[k];
+    // Several samples in the same pixel
+    if ((pos1 == pos0) && (value1 == value0))
+      continue;
+    if (horizontal)
+      dc.DrawLine(pos0, value0, pos1, value1);
+    else
+      dc.DrawLine(value0, pos0, value1, pos1);
+    pos0 = pos1;
+    value0 = value1;
+  }
+}
+
 //-----------------------------------------------------------------------------
 // mpHorizontalLine implementations - functions
 //-----------------------------------------------------------------------------
@@ -982,9 +1544,52 @@ double mpFX::DoGetY(double x)
   return y;
 }
 
+void mpFX::GetYs(const double *xs, double *ys, size_t n)
+{
+  for (size_t k = 0; k < n; k++)
+    ys[k] = GetY(xs[k]);
+}
+
+size_t mpFX::DoGetYs(mpWindow &w, wxCoord startPx, wxCoord endPx)
+{
+  size_t n = (endPx > startPx) ? (endPx - startPx + m_step - 1) / m_step : 0;
+  m_samplesArg.resize(n);
+  m_samplesValue.resize(n);
+  m_samplesPx.resize(n);
+  if (n == 0)
+    return 0;
+
+  if (m_cached)
+    DoGetCachedValues(w.GetPosX(), w.GetScaleX(), false, startPx, n);
+  else
+  {
+    for (size_t k = 0; k < n; k++)
+      m_samplesArg[k] = w.p2x(startPx + k * m_step);
+
+    // Evaluate all the samples in one call
+    DoEvaluate(&m_samplesArg[0], &m_samplesValue[0], n);
+  }
+
+  w.y2pArray(&m_samplesValue[0], &m_samplesPx[0], n, m_UseY2Axis, w.IsLogYaxis());
+  return n;
+}
+
+void mpFX::DoGetSamples(mpWindow &w, const double *pos, double *values, size_t n)
+{
+  m_samplesArg.resize(n);
+  for (size_t k = 0; k < n; k++)
+    m_samplesArg[k] = w.GetPosX() + pos[k] / w.GetScaleX();
+  DoEvaluate(&m_samplesArg[0], values, n);
+
+  bool logY = w.IsLogYaxis();
+  for (size_t k = 0; k < n; k++)
+    values[k] = ClampCoord((w.GetPosY(m_UseY2Axis) - (logY ? log10(values[k]) : values[k])) * w.GetScaleY(m_UseY2Axis));
+}
+
 void mpFX::DoPlot(wxDC &dc, mpWindow &w)
 {
-  wxCoord i, iy, iylast;
+  wxCoord i;
+  size_t k, n;
 
   // Get bondaries
   m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
@@ -997,48 +1602,53 @@ void mpFX::DoPlot(wxDC &dc, mpWindow &w)
     dc.SetClippingRegion(rect);
   }
 
-  if (m_continuous || (m_pen.GetWidth() > 1))
+  // The symbols are drawn at each step, so they need the regular sampling
+  if (m_continuous && m_adaptive && (m_symbol == mpsNone))
   {
-    if (m_continuous)
-    {
-      // Get first point
-      iylast = w.y2p(DoGetY(w.p2x(m_plotBondaries.startPx)), m_UseY2Axis);
-
-      for (i = m_plotBondaries.startPx + m_step; i < m_plotBondaries.endPx; i += m_step)
-      {
-        iy = w.y2p(DoGetY(w.p2x(i)), m_UseY2Axis);
-        dc.DrawLine(i - m_step, iylast, i, iy);
-        if (m_symbol != mpsNone)
-          DrawSymbol(dc, i - m_step, iylast);
-        iylast = iy;
-      }
-      // Last point
-      if (m_symbol != mpsNone)
-        DrawSymbol(dc, i - m_step, iylast);
-    }
-    else
-    {
-      for (i = m_plotBondaries.startPx; i < m_plotBondaries.endPx; i += m_step)
-      {
-        iy = w.y2p(DoGetY(w.p2x(i)), m_UseY2Axis);
-        if (m_symbol == mpsNone)
-          dc.DrawLine(i, iy, i, iy);
-        else
-          DrawSymbol(dc, i, iy);
-      }
-    }
+    n = DoAdaptiveSampling(w, m_plotBondaries.startPx, m_plotBondaries.endPx);
+    DrawAdaptiveSamples(dc, n, true);
   }
   else
   {
-    for (i = m_plotBondaries.startPx; i < m_plotBondaries.endPx; i += m_step)
-    {
-      iy = w.y2p(DoGetY(w.p2x(i)), m_UseY2Axis);
-      if (m_symbol == mpsNone)
-        dc.DrawPoint(i, iy);
-      else
-        DrawSymbol(dc, i, iy);
-    }
-  }
+    n = DoGetYs(w, m_plotBondaries.startPx, m_plotBondaries.endPx);
+
+    if (m_continuous || (m_pen.GetWidth() > 1))
+    {
+      if (m_continuous)
+      {
+        for (k = 1; k < n; k++)
+        {
+          i = m_plotBondaries.startPx + k * m_step;
+          dc.DrawLine(i - m_step, m_samplesPx[k - 1], i, m_samplesPx[k]);
+          if (m_symbol != mpsNone)
+            DrawSymbol(dc, i - m_step, m_samplesPx[k - 1]);
+        }
+        // Last point
+        if ((m_symbol != mpsNone) && (n > 0))
+          DrawSymbol(dc, m_plotBondaries.startPx + (n - 1) * m_step, m_samplesPx[n - 1]);
+      }
+      else
+      {
+        for (k = 0, i = m_plotBondaries.startPx; k < n; k++, i += m_step)
+        {
+          if (m_symbol == mpsNone)
+            dc.DrawLine(i, m_samplesPx[k], i, m_samplesPx[k]);
+          else
+            DrawSymbol(dc, i, m_samplesPx[k]);
+        }
+      }
+    }
+    else
+    {
+      for (k = 0, i = m_plotBondaries.startPx; k < n; k++, i += m_step)
+      {
+        if (m_symbol == mpsNone)
+          dc.DrawPoint(i, m_samplesPx[k]);
+        else
+          DrawSymbol(dc, i, m_samplesPx[k]);
+      }
+    }
+  }
 
   // Destroy clipping
   if (!m_drawOutsideMargins)
@@ -1070,6 +1680,416 @@ void mpFX::DoPlot(wxDC &dc, mpWindow &w)
   }
 }
 
+//-----------------------------------------------------------------------------
+// mpFXExpression implementations - functions
+//-----------------------------------------------------------------------------
+
+IMPLEMENT_DYNAMIC_CLASS(mpFXExpression, mpFX)
+
+// Number of arguments evaluated by each instruction
+#define mpEXPR_BLOCK  256
+
+/**
+ * Recursive descent parser of the formulas of mpFXExpression. Each method emits the bytecode of its rule.
+ * The parser state only lives during SetExpression.
+ */
+class mpExpressionParser
+{
+  public:
+    mpExpressionParser(const std::string &source, std::vector<mpExpressionInstr> &code, size_t &stackSize) :
+        m_source(source), m_pos(0), m_depth(0), m_code(code), m_stackSize(stackSize)
+    {
+      ;
+    }
+
+    /** Parse the whole formula.
+     @return false on syntax error */
+    bool Parse()
+    {
+      return ParseSum() && (Peek() == 0);
+    }
+
+    /** Current position in the formula, the position of the error after Parse */
+    size_t GetPos() const
+    {
+      return m_pos;
+    }
+
+  private:
+    const std::string &m_source;             //!< The formula being parsed
+    size_t m_pos;                            //!< Current position in m_source
+    size_t m_depth;                          //!< Current depth of the stack
+    std::vector<mpExpressionInstr> &m_code;  //!< The bytecode
+    size_t &m_stackSize;                     //!< Maximum depth of the stack used by the bytecode
+
+    /** @return false on syntax error */
+    bool ParseSum();
+    bool ParseProduct();
+    bool ParseUnary();
+    bool ParsePower();
+    bool ParsePrimary();
+
+    /** Skip the spaces and get the next character, 0 at the end */
+    char Peek();
+
+    /** Append an instruction and update the depth of the stack */
+    void Emit(mpExpressionOp op, double value = 0);
+};
+
+char mpExpressionParser::Peek()
+{
+  while ((m_pos < m_source.size()) && isspace((unsigned char)m_source[m_pos]))
+    m_pos++;
+  return (m_pos < m_source.size()) ? m_source[m_pos] : 0;
+}
+
+void mpExpressionParser::Emit(mpExpressionOp op, double value)
+{
+  mpExpressionInstr instr;
+  instr.op = op;
+  instr.value = value;
+  m_code.push_back(instr);
+
+  if ((op == mpEXPR_CONST) || (op == mpEXPR_X))
+  {
+    m_depth++;
+    if (m_depth > m_stackSize)
+      m_stackSize = m_depth;
+  }
+  else
+    if ((op == mpEXPR_ADD) || (op == mpEXPR_SUB) || (op == mpEXPR_MUL) || (op == mpEXPR_DIV) || (op == mpEXPR_POW))
+      m_depth--;
+}
+
+// sum := product (('+' | '-') product)*
+bool mpExpressionParser::ParseSum()
+{
+  if (!ParseProduct())
+    return false;
+  while ((Peek() == '+') || (Peek() == '-'))
+  {
+    char op = m_source[m_pos++];
+    if (!ParseProduct())
+      return false;
+    Emit(op == '+' ? mpEXPR_ADD : mpEXPR_SUB);
+  }
+  return true;
+}
+
+// product := unary (('*' | '/') unary)*
+bool mpExpressionParser::ParseProduct()
+{
+  if (!ParseUnary())
+    return false;
+  while ((Peek() == '*') || (Peek() == '/'))
+  {
+    char op = m_source[m_pos++];
+    if (!ParseUnary())
+      return false;
+    Emit(op == '*' ? mpEXPR_MUL : mpEXPR_DIV);
+  }
+  return true;
+}
+
+// unary := ('-' | '+') unary | power
+bool mpExpressionParser::ParseUnary()
+{
+  char c = Peek();
+  if ((c == '-') || (c == '+'))
+  {
+    m_pos++;
+    if (!ParseUnary())
+      return false;
+    if (c == '-')
+      Emit(mpEXPR_NEG);
+    return true;
+  }
+  return ParsePower();
+}
+
+// power := primary ('^' unary)?
+bool mpExpressionParser::ParsePower()
+{
+  if (!ParsePrimary())
+    return false;
+  if (Peek() == '^')
+  {
+    m_pos++;
+    if (!ParseUnary())
+      return false;
+    Emit(mpEXPR_POW);
+  }
+  return true;
+}
+
+// primary := number | 'x' | constant | function '(' sum ')' | '(' sum ')'
+bool mpExpressionParser::ParsePrimary()
+{
+  char c = Peek();
+
+  if (c == '(')
+  {
+    m_pos++;
+    if (!ParseSum() || (Peek() != ')'))
+      return false;
+    m_pos++;
+    return true;
+  }
+
+  // Number, independent of the locale
+  if (isdigit((unsigned char)c) || (c == '.'))
+  {
+    size_t start = m_pos;
+    while ((m_pos < m_source.size()) && (isdigit((unsigned char)m_source[m_pos]) || (m_source[m_pos] == '.')))
+      m_pos++;
+    if ((m_pos < m_source.size()) && ((m_source[m_pos] == 'e') || (m_source[m_pos] == 'E')))
+    {
+      size_t exponent = m_pos + 1;
+      if ((exponent < m_source.size()) && ((m_source[exponent] == '+') || (m_source[exponent] == '-')))
+        exponent++;
+      // Not an exponent, may be the constant e
+      if ((exponent < m_source.size()) && isdigit((unsigned char)m_source[exponent]))
+      {
+        m_pos = exponent;
+        while ((m_pos < m_source.size()) && isdigit((unsigned char)m_source[m_pos]))
+          m_pos++;
+      }
+    }
+    std::istringstream stream(m_source.substr(start, m_pos - start));
+    stream.imbue(std::locale::classic());
+    double value;
+    // All the characters must be used, for example "1.2.3" is not a number
+    if (!(stream >> value) || (stream.peek() != std::char_traits<char>::eof()))
+    {
+      m_pos = start;
+      return false;
+    }
+    Emit(mpEXPR_CONST, value);
+    return true;
+  }
+
+  // Identifier: argument, constant or function
+  if (isalpha((unsigned char)c))
+  {
+    size_t start = m_pos;
+    while ((m_pos < m_source.size()) && (isalnum((unsigned char)m_source[m_pos]) || (m_source[m_pos] == '_')))
+      m_pos++;
+    std::string name = m_source.substr(start, m_pos - start);
+
+    if (name == "x")
+      Emit(mpEXPR_X);
+    else
+      if (name == "pi")
+        Emit(mpEXPR_CONST, M_PI);
+      else
+        if (name == "e")
+          Emit(mpEXPR_CONST, exp(1.0));
+        else
+        {
+          static const struct
+          {
+              const char *name;
+              mpExpressionOp op;
+          } functions[] = {{"sin", mpEXPR_SIN}, {"cos", mpEXPR_COS}, {"tan", mpEXPR_TAN}, {"asin", mpEXPR_ASIN},
+              {"acos", mpEXPR_ACOS}, {"atan", mpEXPR_ATAN}, {"sinh", mpEXPR_SINH}, {"cosh", mpEXPR_COSH},
+              {"tanh", mpEXPR_TANH}, {"exp", mpEXPR_EXP}, {"log", mpEXPR_LOG}, {"log10", mpEXPR_LOG10},
+              {"sqrt", mpEXPR_SQRT}, {"abs", mpEXPR_ABS}};
+          size_t i;
+          for (i = 0; i < sizeof(functions) / sizeof(functions[0]); i++)
+            if (name == functions[i].name)
+              break;
+          if (i == sizeof(functions) / sizeof(functions[0]))
+          {
+            // Unknown identifier
+            m_pos = start;
+            return false;
+          }
+          if (Peek() != '(')
+            return false;
+          m_pos++;
+          if (!ParseSum() || (Peek() != ')'))
+            return false;
+          m_pos++;
+          Emit(functions[i].op);
+        }
+    return true;
+  }
+
+  return false;
+}
+
+mpFXExpression::mpFXExpression(const wxString &expression, const wxString &name, int flags, bool useY2Axis) :
+    mpFX(name, flags, useY2Axis)
+{
+  m_stackSize = 0;
+  if (!expression.IsEmpty())
+    SetExpression(expression);
+}
+
+bool mpFXExpression::SetExpression(const wxString &expression)
+{
+  m_expression = expression;
+  m_code.clear();
+  m_stackSize = 0;
+  InvalidateCache();
+
+  std::string source(expression.mb_str());
+  mpExpressionParser parser(source, m_code, m_stackSize);
+  if (!parser.Parse())
+  {
+    wxLogError(_T("[mpFXExpression] Error: syntax error at position %d in \"%s\""), (int)parser.GetPos(), expression);
+    m_code.clear();
+    return false;
+  }
+  return true;
+}
+
+double mpFXExpression::GetY(double x)
+{
+  double y;
+  GetYs(&x, &y, 1);
+  return y;
+}
+
+void mpFXExpression::GetYs(const double *xs, double *ys, size_t n)
+{
+  if (m_code.empty())
+  {
+    for (size_t i = 0; i < n; i++)
+      ys[i] = 0;
+    return;
+  }
+
+  // Each slot of the stack holds a block of values. The stack is kept per thread, so the evaluation
+  // stays thread safe, and it only grows : no allocation once it is large enough for the formula.
+  static thread_local std::vector<double> stack;
+  size_t block = wxMin(n, (size_t)mpEXPR_BLOCK);
+  if (stack.size() < m_stackSize * block)
+    stack.resize(m_stackSize * mpEXPR_BLOCK);
+
+  for (size_t first = 0; first < n; first += block)
+  {
+    size_t count = wxMin(block, n - first);
+    const double *x = xs + first;
+    size_t depth = 0;
+
+    for (std::vector<mpExpressionInstr>::const_iterator it = m_code.begin(); it != m_code.end(); it++)
+    {
+      // Slot of the top of the stack, and slot below it for the binary operations
+      double *top = (depth > 0) ? &stack[(depth - 1) * block] : NULL;
+      double *a = (depth > 1) ? &stack[(depth - 2) * block] : NULL;
+      switch (it->op)
+      {
+        case mpEXPR_CONST:
+          top = &stack[depth++ * block];
+          for (size_t i = 0; i < count; i++)
+            top[i] = it->value;
+          break;
+        case mpEXPR_X:
+          top = &stack[depth++ * block];
+          for (size_t i = 0; i < count; i++)
+            top[i] = x[i];
+          break;
+        case mpEXPR_ADD:
+          for (size_t i = 0; i < count; i++)
+            a[i] += top[i];
+          depth--;
+          break;
+        case mpEXPR_SUB:
+          for (size_t i = 0; i < count; i++)
+            a[i] -= top[i];
+          depth--;
+          break;
+        case mpEXPR_MUL:
+          for (size_t i = 0; i < count; i++)
+            a[i] *= top[i];
+          depth--;
+          break;
+        case mpEXPR_DIV:
+          for (size_t i = 0; i < count; i++)
+            a[i] /= top[i];
+          depth--;
+          break;
+        case mpEXPR_POW:
+          for (size_t i = 0; i < count; i++)
+            a[i] = pow(a[i], top[i]);
+          depth--;
+          break;
+        case mpEXPR_NEG:
+          for (size_t i = 0; i < count; i++)
+            top[i] = -top[i];
+          break;
+        case mpEXPR_SIN:
+          for (size_t i = 0; i < count; i++)
+            top[i] = sin(top[i]);
+          break;
+        case mpEXPR_COS:
+          for (size_t i = 0; i < count; i++)
+            top[i] = cos(top[i]);
+          break;
+        case mpEXPR_TAN:
+          for (size_t i = 0; i < count; i++)
+            top[i] = tan(top[i]);
+          break;
+        case mpEXPR_ASIN:
+          for (size_t i = 0; i < count; i++)
+            top[i] = asin(top[i]);
+          break;
+        case mpEXPR_ACOS:
+          for (size_t i = 0; i < count; i++)
+            top[i] = acos(top[i]);
+          break;
+        case mpEXPR_ATAN:
+          for (size_t i = 0; i < count; i++)
+            top[i] = atan(top[i]);
+          break;
+        case mpEXPR_SINH:
+          for (size_t i = 0; i < count; i++)
+            top[i] = sinh(top[i]);
+          break;
+        case mpEXPR_COSH:
+          for (size_t i = 0; i < count; i++)
+            top[i] = cosh(top[i]);
+          break;
+        case mpEXPR_TANH:
+          for (size_t i = 0; i < count; i++)
+            top[i] = tanh(top[i]);
+          break;
+        case mpEXPR_EXP:
+          for (size_t i = 0; i < count; i++)
+            top[i] = exp(top[i]);
+          break;
+        case mpEXPR_LOG:
+          for (size_t i = 0; i < count; i++)
+            top[i] = log(top[i]);
+          break;
+        case mpEXPR_LOG10:
+          for (size_t i = 0; i < count; i++)
+            top[i] = log10(top[i]);
+          break;
+        case mpEXPR_SQRT:
+          for (size_t i = 0; i < count; i++)
+            top[i] = sqrt(top[i]);
+          break;
+        case mpEXPR_ABS:
+          for (size_t i = 0; i < count; i++)
+            top[i] = fabs(top[i]);
+          break;
+      }
+    }
+
+    // The result is the only value left on the stack
+    for (size_t i = 0; i < count; i++)
+      ys[first + i] = stack[i];
+  }
+}
+
+void mpFXExpression::DoPlot(wxDC &dc, mpWindow &w)
+{
+  if (IsValid())
+    mpFX::DoPlot(dc, w);
+}
+
 //-----------------------------------------------------------------------------
 // mpFY implementations - functions
 //-----------------------------------------------------------------------------
@@ -1090,9 +2110,52 @@ double mpFY::DoGetX(double y)
   return x;
 }
 
+void mpFY::GetXs(const double *ys, double *xs, size_t n)
+{
+  for (size_t k = 0; k < n; k++)
+    xs[k] = GetX(ys[k]);
+}
+
+size_t mpFY::DoGetXs(mpWindow &w, wxCoord startPy, wxCoord endPy)
+{
+  size_t n = (endPy > startPy) ? (endPy - startPy + m_step - 1) / m_step : 0;
+  m_samplesArg.resize(n);
+  m_samplesValue.resize(n);
+  m_samplesPx.resize(n);
+  if (n == 0)
+    return 0;
+
+  if (m_cached)
+    DoGetCachedValues(w.GetPosY(m_UseY2Axis), w.GetScaleY(m_UseY2Axis), true, startPy, n);
+  else
+  {
+    for (size_t k = 0; k < n; k++)
+      m_samplesArg[k] = w.p2y(startPy + k * m_step, m_UseY2Axis);
+
+    // Evaluate all the samples in one call
+    DoEvaluate(&m_samplesArg[0], &m_samplesValue[0], n);
+  }
+
+  w.x2pArray(&m_samplesValue[0], &m_samplesPx[0], n, w.IsLogXaxis());
+  return n;
+}
+
+void mpFY::DoGetSamples(mpWindow &w, const double *pos, double *values, size_t n)
+{
+  m_samplesArg.resize(n);
+  for (size_t k = 0; k < n; k++)
+    m_samplesArg[k] = w.GetPosY(m_UseY2Axis) - pos[k] / w.GetScaleY(m_UseY2Axis);
+  DoEvaluate(&m_samplesArg[0], values, n);
+
+  bool logX = w.IsLogXaxis();
+  for (size_t k = 0; k < n; k++)
+    values[k] = ClampCoord(((logX ? log10(values[k]) : values[k]) - w.GetPosX()) * w.GetScaleX());
+}
+
 void mpFY::DoPlot(wxDC &dc, mpWindow &w)
 {
-  wxCoord i, ix, ixlast;
+  wxCoord i;
+  size_t k, n;
 
   // Get bondaries
   m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
@@ -1105,48 +2168,53 @@ void mpFY::DoPlot(wxDC &dc, mpWindow &w)
     dc.SetClippingRegion(rect);
   }
 
-  if (m_continuous || (m_pen.GetWidth() > 1))
+  // The symbols are drawn at each step, so they need the regular sampling
+  if (m_continuous && m_adaptive && (m_symbol == mpsNone))
   {
-    if (m_continuous)
-    {
-      // Get first point
-      ixlast = w.x2p(DoGetX(w.p2y(m_plotBondaries.startPy, m_UseY2Axis)));
+    n = DoAdaptiveSampling(w, m_plotBondaries.startPy, m_plotBondaries.endPy);
+    DrawAdaptiveSamples(dc, n, false);
+  }
+  else
+  {
+    n = DoGetXs(w, m_plotBondaries.startPy, m_plotBondaries.endPy);
 
-      for (i = m_plotBondaries.startPy + m_step; i < m_plotBondaries.endPy; i += m_step)
+    if (m_continuous || (m_pen.GetWidth() > 1))
+    {
+      if (m_continuous)
       {
-        ix = w.x2p(DoGetX(w.p2y(i, m_UseY2Axis)));
-        dc.DrawLine(ixlast, i - m_step, ix, i);
-        if (m_symbol != mpsNone)
-          DrawSymbol(dc, ixlast, i - m_step);
-        ixlast = ix;
+        for (k = 1; k < n; k++)
+        {
+          i = m_plotBondaries.startPy + k * m_step;
+          dc.DrawLine(m_samplesPx[k - 1], i - m_step, m_samplesPx[k], i);
+          if (m_symbol != mpsNone)
+            DrawSymbol(dc, m_samplesPx[k - 1], i - m_step);
+        }
+        // Last point
+        if ((m_symbol != mpsNone) && (n > 0))
+          DrawSymbol(dc, m_samplesPx[n - 1], m_plotBondaries.startPy + (n - 1) * m_step);
+      }
+      else
+      {
+        for (k = 0, i = m_plotBondaries.startPy; k < n; k++, i += m_step)
+        {
+          if (m_symbol == mpsNone)
+            dc.DrawLine(m_samplesPx[k], i, m_samplesPx[k], i);
+          else
+            DrawSymbol(dc, m_samplesPx[k], i);
+        }
       }
-      // Last point
-      if (m_symbol != mpsNone)
-        DrawSymbol(dc, ixlast, i - m_step);
     }
     else
     {
-      for (i = m_plotBondaries.startPy; i < m_plotBondaries.endPy; i += m_step)
+      for (k = 0, i = m_plotBondaries.startPy; k < n; k++, i += m_step)
       {
-        ix = w.x2p(DoGetX(w.p2y(i, m_UseY2Axis)));
         if (m_symbol == mpsNone)
-          dc.DrawLine(ix, i, ix, i);
+          dc.DrawPoint(m_samplesPx[k], i);
         else
-          DrawSymbol(dc, ix, i);
+          DrawSymbol(dc, m_samplesPx[k], i);
       }
     }
   }
-  else
-  {
-    for (i = m_plotBondaries.startPy; i < m_plotBondaries.endPy; i += m_step)
-    {
-      ix = w.x2p(DoGetX(w.p2y(i, m_UseY2Axis)));
-      if (m_symbol == mpsNone)
-        dc.DrawPoint(ix, i);
-      else
-        DrawSymbol(dc, ix, i);
-    }
-  }
 
   // Destroy clipping
   if (!m_drawOutsideMargins)
@@ -1190,6 +2258,7 @@ mpFXY::mpFXY(const wxString &name, int flags, bool viewAsBar, bool useY2Axis) :
   m_flags = flags;
   maxDrawX = minDrawX = maxDrawY = minDrawY = 0;
   m_deltaX = m_deltaY = 1e+308; // Big number
+  m_decimation = mpDECIMATION_NONE;
   SetViewMode(viewAsBar);
 }
 
@@ -1228,108 +2297,301 @@ bool mpFXY::DoGetNextXY(double *x, double *y)
   return result;
 }
 
-void mpFXY::DoPlot(wxDC &dc, mpWindow &w)
+// Number of points of a chunk for GetNextXYs
+#define mpXY_CHUNK  256
+
+size_t mpFXY::GetNextXYs(double *xs, double *ys, size_t n)
 {
-  double x, y;
-  // Do this to reset the counters to evaluate bounding box for label positioning
-  Rewind();
-  // Get first point
-  DoGetNextXY(&x, &y);
-  maxDrawX = minDrawX = (int)x;
-  maxDrawY = minDrawY = (int)y;
+  size_t i = 0;
+  while ((i < n) && GetNextXY(&xs[i], &ys[i]))
+    i++;
+  return i;
+}
 
-  wxCoord ix = 0, iy = 0;
-  wxCoord ixlast = 0, iylast = 0;
+size_t mpFXY::DoGetNextXYs(double *xs, double *ys, size_t n)
+{
+  size_t count = GetNextXYs(xs, ys, n);
+  if (m_win->IsLogXaxis())
+    for (size_t i = 0; i < count; i++)
+      xs[i] = log10(xs[i]);
+  if (m_win->IsLogYaxis())
+    for (size_t i = 0; i < count; i++)
+      ys[i] = log10(ys[i]);
+  return count;
+}
 
-  // Get bondaries
-  m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
+void mpFXY::SetDecimation(mpDecimation decimation)
+{
+  m_decimation = decimation;
+  if (m_win)
+    m_win->InvalidateFrame();
+}
 
-  if (!m_drawOutsideMargins)
-  {
-    wxRect rect(m_plotBondaries.startPx , m_plotBondaries.startPy,
-        m_plotBondaries.endPx - m_plotBondaries.startPx,
-        m_plotBondaries.endPy - m_plotBondaries.startPy);
-    dc.SetClippingRegion(rect);
-  }
+size_t mpFXY::DoDecimate(const double *xs, const double *ys, size_t count)
+{
+  m_decimXs.clear();
+  m_decimYs.clear();
 
-  if (!m_ViewAsBar)
+  if (m_decimation == mpDECIMATION_MINMAX)
   {
-    if (m_continuous || (m_pen.GetWidth() > 1))
+    // Min and max of each bucket, in the order of the points. First and last points are kept.
+    size_t bucket = 2 * m_step;
+    m_decimXs.push_back(xs[0]);
+    m_decimYs.push_back(ys[0]);
+    for (size_t first = 1; first + 1 < count; first += bucket)
     {
-      if (m_continuous)
+      size_t last = wxMin(first + bucket, count - 1);
+      size_t imin = first, imax = first;
+      for (size_t i = first + 1; i < last; i++)
       {
-        // Get first point in bound
-        ixlast = w.x2p(x);
-        iylast = w.y2p(y, m_UseY2Axis);
-
-        while (DoGetNextXY(&x, &y))
-        {
-          ix = w.x2p(x);
-          iy = w.y2p(y, m_UseY2Axis);
-
-          dc.DrawLine(ixlast, iylast, ix, iy);
-          UpdateViewBoundary(ix, iy);
-
-          if (m_symbol != mpsNone)
-            DrawSymbol(dc, ixlast, iylast);
-
-          ixlast = ix;
-          iylast = iy;
-        }
-        // Last point
-        if (m_symbol != mpsNone)
-          DrawSymbol(dc, ixlast, iylast);
+        if (ys[i] < ys[imin])
+          imin = i;
+        if (ys[i] > ys[imax])
+          imax = i;
       }
-      else
+      size_t i1 = wxMin(imin, imax), i2 = wxMax(imin, imax);
+      m_decimXs.push_back(xs[i1]);
+      m_decimYs.push_back(ys[i1]);
+      if (i2 != i1)
       {
-        Rewind();
-        while (DoGetNextXY(&x, &y))
-        {
-          ix = w.x2p(x);
-          iy = w.y2p(y, m_UseY2Axis);
-          if (m_symbol == mpsNone)
-            dc.DrawLine(ix, iy, ix, iy);
-          else
-            DrawSymbol(dc, ix, iy);
-          UpdateViewBoundary(ix, iy);
-        }
+        m_decimXs.push_back(xs[i2]);
+        m_decimYs.push_back(ys[i2]);
       }
     }
-    else
+    if (count > 1)
+    {
+      m_decimXs.push_back(xs[count - 1]);
+      m_decimYs.push_back(ys[count - 1]);
+    }
+    return m_decimXs.size();
+  }
+
+  // Largest-Triangle-Three-Buckets
+  size_t threshold = count / m_step;
+  if (threshold < 3)
+    threshold = wxMin(count, (size_t)3);
+  if (threshold >= count)
+  {
+    m_decimXs.assign(xs, xs + count);
+    m_decimYs.assign(ys, ys + count);
+    return count;
+  }
+
+  double every = (double)(count - 2) / (threshold - 2);
+  size_t a = 0;
+  m_decimXs.push_back(xs[0]);
+  m_decimYs.push_back(ys[0]);
+  for (size_t i = 0; i < threshold - 2; i++)
+  {
+    // Average of the next bucket, the third point of the triangle
+    size_t avgFirst = (size_t)((i + 1) * every) + 1;
+    size_t avgLast = wxMin((size_t)((i + 2) * every) + 1, count);
+    if (avgLast <= avgFirst)
+      avgLast = avgFirst + 1;
+    double avgX = 0, avgY = 0;
+    for (size_t j = avgFirst; j < avgLast; j++)
+    {
+      avgX += xs[j];
+      avgY += ys[j];
+    }
+    avgX /= (avgLast - avgFirst);
+    avgY /= (avgLast - avgFirst);
+
+    // Point of the current bucket giving the largest triangle with the previous kept point
+    size_t first = (size_t)(i * every) + 1;
+    size_t last = (size_t)((i + 1) * every) + 1;
+    double maxArea = -1;
+    size_t kept = first;
+    for (size_t j = first; j < last; j++)
     {
-      // Not continuous and pen width = 1
-      Rewind();
-      while (DoGetNextXY(&x, &y))
+      double area = fabs((xs[a] - avgX) * (ys[j] - ys[a]) - (xs[a] - xs[j]) * (avgY - ys[a]));
+      if (area > maxArea)
       {
-        ix = w.x2p(x);
-        iy = w.y2p(y, m_UseY2Axis);
-        if (m_symbol == mpsNone)
-          dc.DrawPoint(ix, iy);
-        else
-          DrawSymbol(dc, ix, iy);
-        UpdateViewBoundary(ix, iy);
+        maxArea = area;
+        kept = j;
       }
     }
+    m_decimXs.push_back(xs[kept]);
+    m_decimYs.push_back(ys[kept]);
+    a = kept;
   }
-  else // View as bar
+  m_decimXs.push_back(xs[count - 1]);
+  m_decimYs.push_back(ys[count - 1]);
+  return m_decimXs.size();
+}
+
+template <mpPlotLoop loop, bool symbol>
+void mpFXY::DoPlotPoints(wxDC &dc, mpWindow &w, const double *xs, const double *ys, size_t count, size_t stride,
+    double originX, double originY)
+{
+  const wxCoord iybase = w.y2p(0, m_UseY2Axis);
+  wxCoord ixs[mpXY_CHUNK], iys[mpXY_CHUNK];
+  double chunkXs[mpXY_CHUNK], chunkYs[mpXY_CHUNK];
+
+  wxCoord ixlast, iylast;
+  w.x2pArray(xs, &ixlast, 1, false, originX);
+  w.y2pArray(ys, &iylast, 1, m_UseY2Axis, false, originY);
+  maxDrawX = minDrawX = ixlast;
+  maxDrawY = minDrawY = iylast;
+
+  size_t k = (loop == mpLOOP_LINES) ? stride : 0;
+  while (k < count)
   {
-    double delta = w.GetScreenX() / w.GetScaleX();
-    if (m_deltaX < delta)
-      delta = m_deltaX;
-    m_BarWidth = (int)((delta * w.GetScaleX()) / 3.5);
-    if (m_BarWidth == 0)
-      m_BarWidth = 1;
-    wxCoord iybase = w.y2p(0, m_UseY2Axis);
-    Rewind();
-    while (DoGetNextXY(&x, &y))
+    // Transform a chunk of points to pixels in one call
+    size_t m = 0;
+    if (stride == 1)
+    {
+      m = wxMin((size_t)mpXY_CHUNK, count - k);
+      w.x2pArray(xs + k, ixs, m, false, originX);
+      w.y2pArray(ys + k, iys, m, m_UseY2Axis, false, originY);
+      k += m;
+    }
+    else
+    {
+      for (; (m < mpXY_CHUNK) && (k < count); m++, k += stride)
+      {
+        chunkXs[m] = xs[k];
+        chunkYs[m] = ys[k];
+      }
+      w.x2pArray(chunkXs, ixs, m, false, originX);
+      w.y2pArray(chunkYs, iys, m, m_UseY2Axis, false, originY);
+    }
+
+    for (size_t j = 0; j < m; j++)
     {
-      ix = w.x2p(x);
-      iy = w.y2p(y, m_UseY2Axis);
-      dc.DrawRectangle(ix - m_BarWidth, iy, 2 * m_BarWidth, iybase - iy);
+      wxCoord ix = ixs[j], iy = iys[j];
+
+      // The tests on loop and symbol are resolved at compile time
+      if (loop == mpLOOP_LINES)
+      {
+        dc.DrawLine(ixlast, iylast, ix, iy);
+        if (symbol)
+          DrawSymbol(dc, ixlast, iylast);
+        ixlast = ix;
+        iylast = iy;
+      }
+      else
+        if (loop == mpLOOP_BARS)
+          dc.DrawRectangle(ix - m_BarWidth, iy, 2 * m_BarWidth, iybase - iy);
+        else
+          if (symbol)
+            DrawSymbol(dc, ix, iy);
+          else
+            if (loop == mpLOOP_WIDE_POINTS)
+              dc.DrawLine(ix, iy, ix, iy);
+            else
+              dc.DrawPoint(ix, iy);
       UpdateViewBoundary(ix, iy);
     }
   }
 
+  // Last point
+  if ((loop == mpLOOP_LINES) && symbol)
+    DrawSymbol(dc, ixlast, iylast);
+}
+
+void mpFXY::DoPlot(wxDC &dc, mpWindow &w)
+{
+  // Get the points: the arrays of the layer, or a copy through the enumeration
+  const double *xs, *ys;
+  double originX = 0, originY = 0;
+  size_t count, stride = (m_step > 0) ? m_step : 1;
+  bool decimate = (m_decimation != mpDECIMATION_NONE) && (m_step > 1);
+  if (GetXYArrays(&xs, &ys, &count, &originX, &originY))
+  {
+    // Sorted X values : only the slice of the visible range, with the point before and after it for the lines.
+    // The slice starts on a multiple of the step, so the plotted points do not change with the pan.
+    if (IsXSorted() && !w.IsLogXaxis() && (count > 0))
+    {
+      double xmin = w.GetPosX() - originX;
+      double xmax = w.GetPosX() + w.GetScreenX() / w.GetScaleX() - originX;
+      size_t first = std::lower_bound(xs, xs + count, xmin) - xs;
+      size_t last = std::upper_bound(xs, xs + count, xmax) - xs;
+      first = ((first > 0) ? (first - 1) / stride : 0) * stride;
+      last = wxMin(((last + stride - 1) / stride) * stride + 1, count);
+      xs += first;
+      ys += first;
+      count = (last > first) ? last - first : 0;
+    }
+  }
+  else
+  {
+    // The enumeration applies the step : with a decimation, enumerate all the points, the decimation
+    // does the reduction
+    size_t copied;
+    unsigned int step = m_step;
+    if (decimate)
+      m_step = 1;
+    count = 0;
+    Rewind();
+    do
+    {
+      m_plotXs.resize(count + mpXY_CHUNK);
+      m_plotYs.resize(count + mpXY_CHUNK);
+      copied = DoGetNextXYs(&m_plotXs[count], &m_plotYs[count], mpXY_CHUNK);
+      count += copied;
+    } while (copied == mpXY_CHUNK);
+    m_step = step;
+    m_plotXs.resize(count);
+    m_plotYs.resize(count);
+    xs = m_plotXs.data();
+    ys = m_plotYs.data();
+    count = m_plotXs.size();
+    stride = 1;
+  }
+
+  // Decimation in place of the step skip, on the unstepped points
+  if (decimate && (count > 0))
+  {
+    count = DoDecimate(xs, ys, count);
+    xs = m_decimXs.data();
+    ys = m_decimYs.data();
+    stride = 1;
+  }
+
+  // Get bondaries
+  m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
+
+  if (!m_drawOutsideMargins)
+  {
+    wxRect rect(m_plotBondaries.startPx , m_plotBondaries.startPy,
+        m_plotBondaries.endPx - m_plotBondaries.startPx,
+        m_plotBondaries.endPy - m_plotBondaries.startPy);
+    dc.SetClippingRegion(rect);
+  }
+
+  // Choose the plot loop once for the frame
+  bool symbol = (m_symbol != mpsNone);
+  if (count == 0)
+    maxDrawX = minDrawX = maxDrawY = minDrawY = 0;
+  else
+    if (m_ViewAsBar)
+    {
+      double delta = w.GetScreenX() / w.GetScaleX();
+      if (m_deltaX < delta)
+        delta = m_deltaX;
+      m_BarWidth = (int)((delta * w.GetScaleX()) / 3.5);
+      if (m_BarWidth == 0)
+        m_BarWidth = 1;
+      DoPlotPoints<mpLOOP_BARS, false>(dc, w, xs, ys, count, stride, originX, originY);
+    }
+    else
+      if (m_continuous)
+      {
+        if (symbol)
+          DoPlotPoints<mpLOOP_LINES, true>(dc, w, xs, ys, count, stride, originX, originY);
+        else
+          DoPlotPoints<mpLOOP_LINES, false>(dc, w, xs, ys, count, stride, originX, originY);
+      }
+      else
+        if (symbol)
+          DoPlotPoints<mpLOOP_POINTS, true>(dc, w, xs, ys, count, stride, originX, originY);
+        else
+          if (m_pen.GetWidth() > 1)
+            DoPlotPoints<mpLOOP_WIDE_POINTS, false>(dc, w, xs, ys, count, stride, originX, originY);
+          else
+            DoPlotPoints<mpLOOP_POINTS, false>(dc, w, xs, ys, count, stride, originX, originY);
+
   // Destroy clipping
   if (!m_drawOutsideMargins)
   {
@@ -1388,6 +2650,10 @@ mpFXYVector::mpFXYVector(const wxString &name, int flags, bool viewAsBar, bool u
   m_maxY = 1;
   m_xs.clear();
   m_ys.clear();
+  m_xSorted = true;
+  m_yRangeValid = false;
+  m_logXsValid = m_logYsValid = false;
+  m_originX = m_originY = 0;
   SetReserve(1000);
 }
 
@@ -1397,45 +2663,153 @@ bool mpFXYVector::GetNextXY(double *x, double *y)
     return false;
   else
   {
-    *x = m_xs[m_index];
-    *y = m_ys[m_index];
+    *x = m_originX + m_xs[m_index];
+    *y = m_originY + m_ys[m_index];
     m_index += m_step;
     return m_index <= m_xs.size();
   }
 }
 
-void mpFXYVector::DrawAddedPoint(double x, double y)
+bool mpFXYVector::DoGetNextXY(double *x, double *y)
+{
+  if (m_index >= m_xs.size())
+    return false;
+
+  bool logX = m_win->IsLogXaxis();
+  bool logY = m_win->IsLogYaxis();
+  UpdateLogData(logX, logY);
+  *x = logX ? m_logXs[m_index] : m_originX + m_xs[m_index];
+  *y = logY ? m_logYs[m_index] : m_originY + m_ys[m_index];
+  m_index += m_step;
+  return m_index <= m_xs.size();
+}
+
+size_t mpFXYVector::GetNextXYs(double *xs, double *ys, size_t n)
+{
+  size_t i = 0;
+  for (; (i < n) && (m_index < m_xs.size()); i++, m_index += m_step)
+  {
+    xs[i] = m_originX + m_xs[m_index];
+    ys[i] = m_originY + m_ys[m_index];
+  }
+  return i;
+}
+
+size_t mpFXYVector::DoGetNextXYs(double *xs, double *ys, size_t n)
+{
+  const double *dataXs, *dataYs;
+  double originX, originY;
+  size_t count, i = 0;
+  GetXYArrays(&dataXs, &dataYs, &count, &originX, &originY);
+  for (; (i < n) && (m_index < count); i++, m_index += m_step)
+  {
+    xs[i] = originX + dataXs[m_index];
+    ys[i] = originY + dataYs[m_index];
+  }
+  return i;
+}
+
+bool mpFXYVector::GetXYArrays(const double **xs, const double **ys, size_t *count, double *originX, double *originY)
+{
+  bool logX = m_win->IsLogXaxis();
+  bool logY = m_win->IsLogYaxis();
+  UpdateLogData(logX, logY);
+  *xs = logX ? m_logXs.data() : m_xs.data();
+  *ys = logY ? m_logYs.data() : m_ys.data();
+  // The log copies are absolute values
+  *originX = logX ? 0 : m_originX;
+  *originY = logY ? 0 : m_originY;
+  *count = m_xs.size();
+  return true;
+}
+
+void mpFXYVector::SetDataOrigin(double originX, double originY)
+{
+  m_originX = originX;
+  m_originY = originY;
+  m_logXsValid = m_logYsValid = false;
+  BBoxChanged();
+}
+
+void mpFXYVector::UpdateLogData(bool logX, bool logY)
+{
+  if (logX && !m_logXsValid)
+  {
+    m_logXs.resize(m_xs.size());
+    for (size_t i = 0; i < m_xs.size(); i++)
+      m_logXs[i] = log10(m_originX + m_xs[i]);
+    m_logXsValid = true;
+  }
+  if (logY && !m_logYsValid)
+  {
+    m_logYs.resize(m_ys.size());
+    for (size_t i = 0; i < m_ys.size(); i++)
+      m_logYs[i] = log10(m_originY + m_ys[i]);
+    m_logYsValid = true;
+  }
+}
+
+void mpFXYVector::DrawAddedPoint(double WXUNUSED(x), double WXUNUSED(y))
 {
   // If we are here, new point is always in bound
   if (!m_visible)
     return;
 
+  // With a decimation, the points drawn depend on the whole series : the frame is rendered again on idle,
+  // once for all the points added before
+  if ((m_step > 1) && (m_decimation != mpDECIMATION_NONE))
+  {
+    m_win->InvalidateFrame();
+    return;
+  }
+
+  // The added point is the last one. The values are relative to the origin of the data.
+  const double *xs, *ys;
+  double originX, originY;
+  size_t count;
+  GetXYArrays(&xs, &ys, &count, &originX, &originY);
+
+  // With a step, only one point every step is drawn
+  size_t stride = (m_step > 0) ? m_step : 1;
+  if ((count - 1) % stride != 0)
+    return;
+
+  wxCoord ix, iy;
+  m_win->x2pArray(xs + count - 1, &ix, 1, false, originX);
+  m_win->y2pArray(ys + count - 1, &iy, 1, m_UseY2Axis, false, originY);
+
+  // Coordinates of the previous point drawn
+  wxCoord ixlast = ix, iylast = iy;
+  if (m_continuous && (count > stride))
+  {
+    m_win->x2pArray(xs + count - 1 - stride, &ixlast, 1, false, originX);
+    m_win->y2pArray(ys + count - 1 - stride, &iylast, 1, m_UseY2Axis, false, originY);
+  }
+
   // Direct access to the dc
   wxClientDC dc(m_win);
+  DrawAddedPointOnDC(dc, ix, iy, ixlast, iylast);
+
+  // Also draw in the last rendered frame, so the point is not lost when the frame is blitted again
+  wxBitmap* frame = m_win->GetFrameBuffer();
+  if (frame)
+  {
+    wxMemoryDC frame_dc(&dc);
+    frame_dc.SelectObject(*frame);
+    DrawAddedPointOnDC(frame_dc, ix, iy, ixlast, iylast);
+    frame_dc.SelectObject(wxNullBitmap);
+  }
+}
+
+void mpFXYVector::DrawAddedPointOnDC(wxDC &dc, wxCoord ix, wxCoord iy, wxCoord ixlast, wxCoord iylast)
+{
   dc.SetPen(m_pen);
   dc.SetBrush(m_brush);
 
-  if (m_win->IsLogXaxis())
-    x = log10(x);
-  if (m_win->IsLogYaxis())
-    y = log10(y);
-  wxCoord ix = m_win->x2p(x);
-  wxCoord iy = m_win->y2p(y, m_UseY2Axis);
-
   if (!m_ViewAsBar)
   {
     if (m_continuous)
     {
-      // Last coordinates (we assume that m_step = 1 in this context)
-      double xlast = m_xs[m_index - 1];
-      if (m_win->IsLogXaxis())
-        xlast = log10(xlast);
-      wxCoord ixlast = m_win->x2p(xlast);
-      double ylast = m_ys[m_index - 1];
-      if (m_win->IsLogYaxis())
-        ylast = log10(ylast);
-      wxCoord iylast = m_win->y2p(ylast, m_UseY2Axis);
-      m_index++;
       dc.DrawLine(ixlast, iylast, ix, iy);
       if (m_symbol != mpsNone)
         DrawSymbol(dc, ix, iy);
@@ -1464,6 +2838,12 @@ void mpFXYVector::Clear()
 {
   m_xs.clear();
   m_ys.clear();
+  m_xSorted = true;
+  m_yRange.Clear();
+  m_yRangeValid = false;
+  m_logXs.clear();
+  m_logYs.clear();
+  m_logXsValid = m_logYsValid = false;
   // Default min max
   m_minX = -1;
   m_maxX = 1;
@@ -1471,6 +2851,7 @@ void mpFXYVector::Clear()
   m_maxY = 1;
   m_deltaX = m_deltaY = 1e+308; // Big number
   Rewind();
+  BBoxChanged();
 }
 
 void mpFXYVector::SetData(const std::vector<double> &xs, const std::vector<double> &ys)
@@ -1484,6 +2865,9 @@ void mpFXYVector::SetData(const std::vector<double> &xs, const std::vector<doubl
   // Copy the data:
   m_xs = xs;
   m_ys = ys;
+  m_xSorted = true;
+  m_yRangeValid = false;
+  m_logXsValid = m_logYsValid = false;
 
   // Update internal variables for the bounding box.
   if (xs.size() > 0)
@@ -1502,6 +2886,8 @@ void mpFXYVector::SetData(const std::vector<double> &xs, const std::vector<doubl
     {
       if (abs((*it) - m_lastX) < m_deltaX)
         m_deltaX = abs((*it) - m_lastX);
+      if ((*it) < m_lastX)
+        m_xSorted = false;
       m_lastX = (*it);
 
       if (*it < m_minX)
@@ -1537,6 +2923,7 @@ void mpFXYVector::SetData(const std::vector<double> &xs, const std::vector<doubl
     m_maxY = 1;
   }
   Rewind();
+  BBoxChanged();
 }
 
 /** Add data to the internal vector. This method DOES NOT refresh the mpWindow; do it manually
@@ -1547,9 +2934,18 @@ bool mpFXYVector::AddData(const double x, const double y, bool updatePlot)
 {
   bool new_limit = false;
   const mpFloatRect* bbox = m_win->GetBoundingBox();
+  double oldMinX = m_minX, oldMaxX = m_maxX, oldMinY = m_minY, oldMaxY = m_maxY;
 
+  if ((!m_xs.empty()) && (x < m_xs.back()))
+    m_xSorted = false;
   m_xs.push_back(x);
   m_ys.push_back(y);
+  if (m_yRangeValid)
+    m_yRange.Append(y);
+  if (m_logXsValid)
+    m_logXs.push_back(log10(m_originX + x));
+  if (m_logYsValid)
+    m_logYs.push_back(log10(m_originY + y));
 
   // first point
   if (m_xs.size() == 1)
@@ -1570,14 +2966,14 @@ bool mpFXYVector::AddData(const double x, const double y, bool updatePlot)
     if (x < m_minX)
     {
       m_minX = x - m_deltaX;
-      if (m_minX < bbox->Xmin)
+      if (m_originX + m_minX < bbox->Xmin)
         new_limit = true;
     }
     else
       if (x > m_maxX)
       {
         m_maxX = x + m_deltaX;
-        if (m_maxX > bbox->Xmax)
+        if (m_originX + m_maxX > bbox->Xmax)
           new_limit = true;
       }
 
@@ -1588,18 +2984,26 @@ bool mpFXYVector::AddData(const double x, const double y, bool updatePlot)
     if (y < m_minY)
     {
       m_minY = y - m_deltaY;
-      if (m_minY < bbox->Ymin)
+      if (m_originY + m_minY < bbox->Ymin)
         new_limit = true;
     }
     else
       if (y > m_maxY)
       {
         m_maxY = y + m_deltaY;
-        if (m_maxY > bbox->Ymax)
+        if (m_originY + m_maxY > bbox->Ymax)
           new_limit = true;
       }
   }
 
+  if ((m_minX != oldMinX) || (m_maxX != oldMaxX) || (m_minY != oldMinY) || (m_maxY != oldMaxY))
+  {
+    BBoxChanged();
+    // The window expands the view with a headroom, so we do not need a fit for each new limit
+    if (m_win && m_win->GetAutoRange())
+      new_limit = m_win->CheckAutoRange();
+  }
+
   if (updatePlot && !new_limit)
   {
     DrawAddedPoint(x, y);
@@ -1609,6 +3013,41 @@ bool mpFXYVector::AddData(const double x, const double y, bool updatePlot)
   return new_limit;
 }
 
+bool mpFXYVector::GetYRange(double xmin, double xmax, double *ymin, double *ymax)
+{
+  if (m_xs.empty())
+    return false;
+
+  // We can not find the points of the range
+  if (!m_xSorted)
+  {
+    *ymin = m_originY + m_minY;
+    *ymax = m_originY + m_maxY;
+    return true;
+  }
+
+  if (!m_yRangeValid)
+  {
+    m_yRange.Build(m_ys);
+    m_yRangeValid = true;
+  }
+
+  // The stored values are relative to the origin
+  size_t first = std::lower_bound(m_xs.begin(), m_xs.end(), xmin - m_originX) - m_xs.begin();
+  size_t last = std::upper_bound(m_xs.begin(), m_xs.end(), xmax - m_originX) - m_xs.begin();
+  // Include the points just outside the range
+  if (first > 0)
+    first--;
+  if (last < m_xs.size())
+    last++;
+
+  if (!m_yRange.Query(first, last, ymin, ymax))
+    return false;
+  *ymin += m_originY;
+  *ymax += m_originY;
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 // mpProfile implementation
 //-----------------------------------------------------------------------------
@@ -1621,6 +3060,12 @@ mpProfile::mpProfile(const wxString &name, int flags) :
   m_flags = flags;
 }
 
+void mpProfile::GetYs(const double *xs, double *ys, size_t n)
+{
+  for (size_t k = 0; k < n; k++)
+    ys[k] = GetY(xs[k]);
+}
+
 void mpProfile::DoPlot(wxDC &dc, mpWindow &w)
 {
   wxCoord i;
@@ -1628,13 +3073,22 @@ void mpProfile::DoPlot(wxDC &dc, mpWindow &w)
   // Get bondaries
   m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
 
+  // Evaluate all the samples in one call. The first point is always needed.
+  size_t k = 0, n = (m_plotBondaries.endPx > m_plotBondaries.startPx) ?
+      (m_plotBondaries.endPx - m_plotBondaries.startPx + m_step - 1) / m_step : 1;
+  m_samplesArg.resize(n);
+  m_samplesValue.resize(n);
+  for (i = m_plotBondaries.startPx; k < n; k++, i += m_step)
+    m_samplesArg[k] = w.p2x(i);
+  GetYs(&m_samplesArg[0], &m_samplesValue[0], n);
+
   // Plot profile linking subsequent point of the profile, instead of mpFY, which plots simple points.
-  wxCoord c0 = w.y2p(GetY(w.p2x(m_plotBondaries.startPx)));
+  wxCoord c0 = w.y2p(m_samplesValue[0]);
   if (!m_drawOutsideMargins)
     c0 = (c0 <= m_plotBondaries.endPy) ? ((c0 >= m_plotBondaries.startPy) ? c0 : m_plotBondaries.startPy) : m_plotBondaries.endPy;
-  for (i = m_plotBondaries.startPx + m_step; i < m_plotBondaries.endPx; i += m_step)
+  for (k = 1, i = m_plotBondaries.startPx + m_step; k < n; k++, i += m_step)
   {
-    wxCoord c1 = w.y2p(GetY(w.p2x(i)));
+    wxCoord c1 = w.y2p(m_samplesValue[k]);
 
     if (!m_drawOutsideMargins)
       c1 = (c1 <= m_plotBondaries.endPy) ? ((c1 >= m_plotBondaries.startPy) ? c1 : m_plotBondaries.startPy) : m_plotBondaries.endPy;
@@ -1692,9 +3146,85 @@ mpScale::mpScale(const wxString &name, int flags, bool grids)
   m_min = -1;
   m_max = 1;
   m_labelFormat = _T("");
+  m_labelCacheStep = 0;
   m_ZIndex = mpZIndex_AXIS;
 }
 
+// Maximum number of labels in the cache of a scale
+#define mpLABEL_CACHE_SIZE 512
+
+bool mpScale::CheckLabelCache(const wxString &format, double step)
+{
+  if ((format != m_labelCacheFormat) || (step != m_labelCacheStep) || (m_font != m_labelCacheFont))
+  {
+    m_labelCache.clear();
+    m_labelCacheFormat = format;
+    m_labelCacheStep = step;
+    m_labelCacheFont = m_font;
+    return true;
+  }
+  return false;
+}
+
+const mpLabel* mpScale::FindLabel(wxInt64 key) const
+{
+  std::unordered_map<wxInt64, mpLabel>::const_iterator it = m_labelCache.find(key);
+  return (it != m_labelCache.end()) ? &it->second : NULL;
+}
+
+// Draw the segments with the current pen
+static void StrokeSegments(wxDC &dc, const std::vector<wxPoint> &begin, const std::vector<wxPoint> &end)
+{
+#if wxUSE_GRAPHICS_CONTEXT
+  // With a graphics context (wxGCDC), all the segments are stroked in one call
+  wxGraphicsContext* gc = dc.GetGraphicsContext();
+  if (gc)
+  {
+    std::vector<wxPoint2DDouble> gcBegin(begin.size()), gcEnd(end.size());
+    for (size_t i = 0; i < begin.size(); i++)
+    {
+      gcBegin[i] = wxPoint2DDouble(begin[i].x, begin[i].y);
+      gcEnd[i] = wxPoint2DDouble(end[i].x, end[i].y);
+    }
+    gc->StrokeLines(gcBegin.size(), gcBegin.data(), gcEnd.data());
+    return;
+  }
+#endif
+  for (size_t i = 0; i < begin.size(); i++)
+    dc.DrawLine(begin[i].x, begin[i].y, end[i].x, end[i].y);
+}
+
+void mpScale::DrawSegments(wxDC &dc)
+{
+  if (!m_gridBegin.empty())
+  {
+    dc.SetPen(m_gridpen);
+    StrokeSegments(dc, m_gridBegin, m_gridEnd);
+  }
+  // Ticks over the grid
+  dc.SetPen(m_pen);
+  if (!m_tickBegin.empty())
+    StrokeSegments(dc, m_tickBegin, m_tickEnd);
+
+  m_gridBegin.clear();
+  m_gridEnd.clear();
+  m_tickBegin.clear();
+  m_tickEnd.clear();
+}
+
+const mpLabel* mpScale::AddLabel(wxDC &dc, wxInt64 key, const wxString &text)
+{
+  // A long pan fills the cache with labels no more visible
+  if (m_labelCache.size() >= mpLABEL_CACHE_SIZE)
+    m_labelCache.clear();
+  mpLabel &label = m_labelCache[key];
+  label.text = text;
+  label.width = label.height = 0;
+  if (!text.IsEmpty())
+    dc.GetTextExtent(text, &label.width, &label.height);
+  return &label;
+}
+
 double mpScale::GetStep(double scale)
 {
 const double DIGIT = 128.0;
@@ -1896,6 +3426,12 @@ void mpScaleX::DoPlot(wxDC &dc, mpWindow &w)
   // Draw X axis
   dc.DrawLine(m_plotBondaries.startPx, orgy, m_plotBondaries.endPx, orgy);
 
+  if (m_labelType == mpX_TIMESTAMP)
+  {
+    DoPlotTimestamp(dc, w, orgy);
+    return;
+  }
+
   const double scaleX = w.GetScaleX();
   const double step = GetStep(scaleX);
   const double end = w.GetPosX() + (double)w.GetScreenX() / scaleX;
@@ -1947,78 +3483,64 @@ void mpScaleX::DoPlot(wxDC &dc, mpWindow &w)
       ;
   }
 
-  double n0 = floor(w.GetPosX() / step) * step;
+  // The ticks are computed from an integer index and not accumulated, so there is no drift with
+  // large coordinates. The pixel is computed from the offset to the first tick, which is small.
+  const double i0 = floor(w.GetPosX() / step);
+  const double tickBase = i0 * step - w.GetPosX();
   double n = 0;
 #ifdef MATHPLOT_DO_LOGGING
-  wxLogMessage(_T("mpScaleX::Plot: step: %f, end: %f, n: %f"), step, end, n0);
+  wxLogMessage(_T("mpScaleX::Plot: step: %f, end: %f, n: %f"), step, end, i0 * step);
 #endif
 
   int labelH = 0; // Control labels heigth to decide where to put axis name (below labels or on top of axis)
   int maxExtent = 0;
-  wxCoord tx, ty;
-  wxString s;
+  const mpLabel* label;
+
+  // The labels are cached by tick index, for the format and the step
+  CheckLabelCache(wxString::Format(_T("%u|%u|%d|"), m_labelType, m_timeConv, IsLogAxis()) + fmt, step);
 
   // Draw grid, ticks and compute max label length
-  for (n = n0; n < end; n += step)
+  for (int i = 0; (n = (i0 + i) * step) < end; i++)
   {
-    const int p = (int)((n - w.GetPosX()) * scaleX);
+    const int p = (int)((tickBase + i * step) * scaleX);
 #ifdef MATHPLOT_DO_LOGGING
     wxLogMessage(_T("mpScaleX::Plot: n: %f -> p = %d"), n, p);
 #endif
     if ((p >= m_plotBondaries.startPx) && (p <= m_plotBondaries.endPx))
     {
-      // draw grid
-      if (m_grids)
-      {
-        dc.SetPen(m_gridpen);
-        dc.DrawLine(p, m_plotBondaries.startPy + 1, p, m_plotBondaries.endPy - 1);
-      }
-
-      // draw axis ticks
-      if (m_ticks)
-      {
-        dc.SetPen(m_pen);
-        if (m_flags == mpALIGN_BORDER_BOTTOM)
-          dc.DrawLine(p, orgy, p, orgy - 4);
-        else
-          dc.DrawLine(p, orgy, p, orgy + 4);
-      }
-
-      // Write ticks labels in s string : compute size
-      s = FormatValue(fmt, n);
+      AddGridAndTick(p, orgy);
 
-      dc.GetTextExtent(s, &tx, &ty);
-      labelH = (labelH <= ty) ? ty : labelH;
-      maxExtent = (tx > maxExtent) ? tx : maxExtent; // Keep in mind max label width
+      // Ticks label and its size, formatted and measured only once
+      label = GetTickLabel(dc, fmt, (wxInt64)(i0 + i), n);
+      labelH = (labelH <= label->height) ? label->height : labelH;
+      maxExtent = (label->width > maxExtent) ? label->width : maxExtent; // Keep in mind max label width
     }
   }
 
+  DrawSegments(dc);
+
   // Actually draw labels, taking care of not overlapping them, and distributing them regularly
-  double labelStep = ceil((maxExtent + MIN_X_AXIS_LABEL_SEPARATION) / (scaleX * step)) * step;
+  int labelTicks = (int)ceil((maxExtent + MIN_X_AXIS_LABEL_SEPARATION) / (scaleX * step));
+  if (labelTicks < 1)
+    labelTicks = 1;
 
-  for (n = n0; n < end; n += labelStep)
+  for (int i = 0; (n = (i0 + i) * step) < end; i += labelTicks)
   {
-    // To have a real zero
-    if (fabs(n) < 1e-10)
-      n = 0;
-
-    const int p = (int)((n - w.GetPosX()) * scaleX);
+    const int p = (int)((tickBase + i * step) * scaleX);
 #ifdef MATHPLOT_DO_LOGGING
     wxLogMessage(_T("mpScaleX::Plot: n_label = %f -> p_label = %d"), n, p);
 #endif
     if ((p >= m_plotBondaries.startPx) && (p <= m_plotBondaries.endPx))
     {
-      // Write ticks labels in s string
-      s = FormatValue(fmt, n);
-
-      dc.GetTextExtent(s, &tx, &ty);
+      // Write ticks labels
+      label = GetTickLabel(dc, fmt, (wxInt64)(i0 + i), n);
       if ((m_flags == mpALIGN_BORDER_BOTTOM) || (m_flags == mpALIGN_TOP))
       {
-        dc.DrawText(s, p - tx / 2, orgy - ty - 4);
+        dc.DrawText(label->text, p - label->width / 2, orgy - label->height - 4);
       }
       else
       {
-        dc.DrawText(s, p - tx / 2, orgy + 4);
+        dc.DrawText(label->text, p - label->width / 2, orgy + 4);
       }
     }
   }
@@ -2027,49 +3549,302 @@ void mpScaleX::DoPlot(wxDC &dc, mpWindow &w)
   DrawScaleName(dc, w, orgy, labelH);
 }
 
-bool mpScaleX::IsLogAxis()
+const mpLabel* mpScaleX::GetTickLabel(wxDC &dc, const wxString &fmt, wxInt64 index, double n)
 {
-  if (m_win)
-    return m_win->IsLogXaxis();
-  else
-    return false;
+  const mpLabel* label = FindLabel(index);
+  if (label)
+    return label;
+
+  // To have a real zero
+  if (fabs(n) < 1e-10)
+    n = 0;
+  return AddLabel(dc, index, FormatValue(fmt, n));
 }
 
-void mpScaleX::SetLogAxis(bool log)
+void mpScaleX::AddGridAndTick(int p, int orgy)
 {
-  if (m_win)
-    m_win->SetLogXaxis(log);
+  // grid
+  if (m_grids)
+  {
+    m_gridBegin.push_back(wxPoint(p, m_plotBondaries.startPy + 1));
+    m_gridEnd.push_back(wxPoint(p, m_plotBondaries.endPy - 1));
+  }
+
+  // axis ticks
+  if (m_ticks)
+  {
+    m_tickBegin.push_back(wxPoint(p, orgy));
+    m_tickEnd.push_back(wxPoint(p, (m_flags == mpALIGN_BORDER_BOTTOM) ? orgy - 4 : orgy + 4));
+  }
 }
 
-//-----------------------------------------------------------------------------
-// mpScaleY
-//-----------------------------------------------------------------------------
+// Minimum space between two ticks of the timestamp mode, in pixels
+#define mpTIME_TICK_SPACING 50
 
-IMPLEMENT_DYNAMIC_CLASS(mpScaleY, mpScale)
+// Calendar aligned steps of the timestamp mode, in nanoseconds, up to the days. The months and years are apart.
+static const wxInt64 mpTimeSteps[] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500,                                      // ns
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,           // us
+    1000000, 2000000, 5000000, 10000000, 20000000, 50000000, 100000000, 200000000, 500000000, // ms
+    mpNS_PER_SECOND, 2 * mpNS_PER_SECOND, 5 * mpNS_PER_SECOND, 10 * mpNS_PER_SECOND, 15 * mpNS_PER_SECOND,
+    30 * mpNS_PER_SECOND,                                                    // s
+    60 * mpNS_PER_SECOND, 120 * mpNS_PER_SECOND, 300 * mpNS_PER_SECOND, 600 * mpNS_PER_SECOND,
+    900 * mpNS_PER_SECOND, 1800 * mpNS_PER_SECOND,                           // min
+    3600 * mpNS_PER_SECOND, 7200 * mpNS_PER_SECOND, 10800 * mpNS_PER_SECOND, 21600 * mpNS_PER_SECOND,
+    43200 * mpNS_PER_SECOND,                                                 // h
+    mpNS_PER_DAY, 2 * mpNS_PER_DAY, 5 * mpNS_PER_DAY, 10 * mpNS_PER_DAY      // days
+};
 
-/**
- * Get the origin of axis and initialize the plot bondaries
- */
-int mpScaleY::GetOrigin(mpWindow &w)
+// Month steps, then years by 1, 2, 5 decades
+static const int mpTimeMonthSteps[] = {1, 2, 3, 6, 12, 24, 60};
+
+// Average length of a month, in nanoseconds
+#define mpNS_PER_MONTH (30.436875 * 86400e9)
+
+// Limit of the timestamps, with room for the offsets and steps added to them
+#define mpTIMESTAMP_MAX ((wxInt64)9000000000000000000LL)
+
+wxInt64 mpScaleX::XToTimestamp(double x) const
 {
-  int origin = 0;
-  // Get bondaries
-  m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
+  // The offset is clamped to be converted, then added to the origin with saturation
+  double ns = floor(x * 1e9 + 0.5);
+  if (ns > 9e18)
+    ns = 9e18;
+  if (ns < -9e18)
+    ns = -9e18;
+  wxInt64 offset = (wxInt64)ns;
+  if ((offset > 0) && (m_timeOrigin > mpTIMESTAMP_MAX - offset))
+    return mpTIMESTAMP_MAX;
+  if ((offset < 0) && (m_timeOrigin < -mpTIMESTAMP_MAX - offset))
+    return -mpTIMESTAMP_MAX;
+  return wxMax(-mpTIMESTAMP_MAX, wxMin(m_timeOrigin + offset, mpTIMESTAMP_MAX));
+}
 
-  switch (m_flags)
+wxInt64 mpScaleX::GetLocalOffset(wxInt64 timestamp)
+{
+  struct tm timestruct;
+  if (m_timeConv != mpX_LOCALTIME)
+    return 0;
+  // A single call to the C library, the ticks are then converted with the offset
+  wxInt64 seconds = FloorDiv(timestamp, mpNS_PER_SECOND);
+  if (!DoubleToTimeStruct((double)seconds, mpX_LOCALTIME, &timestruct))
+    return 0;
+  wxInt64 local = mpTimeConverter::DaysFromCivil(timestruct.tm_year + 1900, timestruct.tm_mon + 1, timestruct.tm_mday) * 86400
+      + timestruct.tm_hour * 3600 + timestruct.tm_min * 60 + timestruct.tm_sec;
+  return (local - seconds) * mpNS_PER_SECOND;
+}
+
+wxInt64 mpScaleX::GetOffsetTransition(wxInt64 start, wxInt64 end, wxInt64 before, wxInt64 after)
+{
+  if ((m_transitionBefore == before) && (m_transitionAfter == after) && (m_transition > start) && (m_transition <= end))
+    return m_transition;
+
+  // Bisection on the offset, one call to the C library by step
+  while (end - start > mpNS_PER_SECOND)
   {
-    // Scale Y : vertical axis
-    case mpALIGN_BORDER_LEFT:
-      origin = 1;
-      break;
-    case mpALIGN_LEFT:
-    {
-      if (m_drawOutsideMargins)
-        origin = Y_BORDER_SEPARATION;
-      else
-        origin = w.GetMarginLeft() - EXTRA_MARGIN - 1;
-      break;
-    }
+    wxInt64 middle = start + (end - start) / 2;
+    if (GetLocalOffset(middle) == before)
+      start = middle;
+    else
+      end = middle;
+  }
+  m_transition = end;
+  m_transitionBefore = before;
+  m_transitionAfter = after;
+  return end;
+}
+
+wxString mpScaleX::FormatTimestamp(wxInt64 timestamp)
+{
+  mpCalendarTime t;
+  m_timeConverter.ToCalendar(timestamp + GetLocalOffset(timestamp), &t);
+  return wxString::Format(_T("%04d-%02d-%02dT%02d:%02d:%02d.%06d"), t.year, t.month, t.day, t.hour, t.minute, t.second,
+      t.nanosecond / 1000);
+}
+
+wxInt64 mpScaleX::GetTimeTicks(wxInt64 start, wxInt64 end, double minStep)
+{
+  m_timeTicks.clear();
+
+  // Fixed steps
+  const size_t nbSteps = sizeof(mpTimeSteps) / sizeof(mpTimeSteps[0]);
+  for (size_t i = 0; i < nbSteps; i++)
+  {
+    const wxInt64 step = mpTimeSteps[i];
+    if (step >= minStep)
+    {
+      for (wxInt64 tick = FloorDiv(start, step) * step; tick <= end; tick += step)
+        m_timeTicks.push_back(tick);
+      return step;
+    }
+  }
+
+  // Months and years: the ticks are the first day of the month
+  int months = 0;
+  const size_t nbMonthSteps = sizeof(mpTimeMonthSteps) / sizeof(mpTimeMonthSteps[0]);
+  for (size_t i = 0; (i < nbMonthSteps) && (months == 0); i++)
+    if (mpTimeMonthSteps[i] * mpNS_PER_MONTH >= minStep)
+      months = mpTimeMonthSteps[i];
+  if (months == 0)
+  {
+    // Decades: 10, 20, 50, 100, ... years
+    const int factors[] = {1, 2, 5, 10};
+    double decade = pow(10, floor(log10(minStep / (120 * mpNS_PER_MONTH))));
+    for (size_t i = 0; (i < 4) && (months * mpNS_PER_MONTH < minStep); i++)
+      months = (int)wxMin(120 * factors[i] * decade, 1e8);
+  }
+
+  int year, month, day;
+  mpTimeConverter::CivilFromDays(FloorDiv(start, mpNS_PER_DAY), &year, &month, &day);
+  wxInt64 index = FloorDiv((wxInt64)year * 12 + month - 1, months) * months;
+  for (;; index += months)
+  {
+    year = (int)FloorDiv(index, 12);
+    wxInt64 tick = mpTimeConverter::DaysFromCivil(year, (int)(index - (wxInt64)year * 12) + 1, 1) * mpNS_PER_DAY;
+    if (tick > end)
+      break;
+    m_timeTicks.push_back(tick);
+  }
+  return (wxInt64)(months * mpNS_PER_MONTH);
+}
+
+wxString mpScaleX::FormatTimeTick(wxInt64 tick, wxInt64 step)
+{
+  mpCalendarTime t;
+  m_timeConverter.ToCalendar(tick, &t);
+
+  if (step > 20 * mpNS_PER_DAY)
+    return wxString::Format(_T("%04d-%02d"), t.year, t.month);
+  // The date at midnight
+  if ((step >= mpNS_PER_DAY) || ((t.hour == 0) && (t.minute == 0) && (t.second == 0) && (t.nanosecond == 0)))
+    return wxString::Format(_T("%04d-%02d-%02d"), t.year, t.month, t.day);
+  if (step >= 60 * mpNS_PER_SECOND)
+    return wxString::Format(_T("%02d:%02d"), t.hour, t.minute);
+  if (step >= mpNS_PER_SECOND)
+    return wxString::Format(_T("%02d:%02d:%02d"), t.hour, t.minute, t.second);
+  if (step >= 1000000)
+    return wxString::Format(_T("%02d:%02d:%02d.%03d"), t.hour, t.minute, t.second, t.nanosecond / 1000000);
+  if (step >= 1000)
+    return wxString::Format(_T("%02d:%02d.%06d"), t.minute, t.second, t.nanosecond / 1000);
+  return wxString::Format(_T("%02d.%09d"), t.second, t.nanosecond);
+}
+
+void mpScaleX::DoPlotTimestamp(wxDC &dc, mpWindow &w, int orgy)
+{
+  const double scaleX = w.GetScaleX();
+  const double posX = w.GetPosX();
+  const wxInt64 start = XToTimestamp(posX);
+  const wxInt64 end = XToTimestamp(posX + (double)w.GetScreenX() / scaleX);
+
+  // The ticks are aligned on the local calendar. The offset is taken once for the frame, unless
+  // it changes in the view (daylight saving time): then the change is found once, and each tick takes
+  // the offset of its side. A view wide enough to hold several changes has ticks of months, where the
+  // error of the other changes is below the pixel.
+  const wxInt64 offset = GetLocalOffset(start);
+  const wxInt64 endOffset = GetLocalOffset(end);
+  const wxInt64 transition = (endOffset != offset) ? GetOffsetTransition(start, end, offset, endOffset) : end;
+  const wxInt64 step = GetTimeTicks(start + offset, end + endOffset, mpTIME_TICK_SPACING * 1e9 / scaleX);
+
+  m_timeTicksPx.resize(m_timeTicks.size());
+  for (size_t i = 0; i < m_timeTicks.size(); i++)
+  {
+    const wxInt64 tickOffset = (m_timeTicks[i] - offset < transition) ? offset : endOffset;
+    m_timeTicksPx[i] = (int)((TimestampToX(m_timeTicks[i] - tickOffset) - posX) * scaleX);
+  }
+
+  int labelH = 0; // Control labels heigth to decide where to put axis name (below labels or on top of axis)
+  int maxExtent = 0;
+  const mpLabel* label;
+
+  // The labels are cached by local timestamp of the tick, for the step
+  CheckLabelCache(wxString::Format(_T("%u"), m_labelType), (double)step);
+
+  // Draw grid, ticks and compute max label length
+  for (size_t i = 0; i < m_timeTicks.size(); i++)
+  {
+    const int p = m_timeTicksPx[i];
+    if ((p >= m_plotBondaries.startPx) && (p <= m_plotBondaries.endPx))
+    {
+      AddGridAndTick(p, orgy);
+
+      label = FindLabel(m_timeTicks[i]);
+      if (!label)
+        label = AddLabel(dc, m_timeTicks[i], FormatTimeTick(m_timeTicks[i], step));
+      labelH = (labelH <= label->height) ? label->height : labelH;
+      maxExtent = (label->width > maxExtent) ? label->width : maxExtent; // Keep in mind max label width
+    }
+  }
+
+  DrawSegments(dc);
+
+  // Draw the labels on a multiple of the ticks, so they do not overlap. The ticks are at least
+  // mpTIME_TICK_SPACING apart, often more since the step is rounded to a calendar step.
+  size_t labelTicks = (size_t)ceil((maxExtent + MIN_X_AXIS_LABEL_SEPARATION) / (step * 1e-9 * scaleX));
+  if (labelTicks < 1)
+    labelTicks = 1;
+  for (size_t i = 0; i < m_timeTicks.size(); i += labelTicks)
+  {
+    const int p = m_timeTicksPx[i];
+    if ((p >= m_plotBondaries.startPx) && (p <= m_plotBondaries.endPx))
+    {
+      // Measured in the first loop
+      label = FindLabel(m_timeTicks[i]);
+      if (!label)
+        label = AddLabel(dc, m_timeTicks[i], FormatTimeTick(m_timeTicks[i], step));
+      if ((m_flags == mpALIGN_BORDER_BOTTOM) || (m_flags == mpALIGN_TOP))
+        dc.DrawText(label->text, p - label->width / 2, orgy - label->height - 4);
+      else
+        dc.DrawText(label->text, p - label->width / 2, orgy + 4);
+    }
+  }
+
+  // Draw axis name
+  DrawScaleName(dc, w, orgy, labelH);
+}
+
+bool mpScaleX::IsLogAxis()
+{
+  if (m_win)
+    return m_win->IsLogXaxis();
+  else
+    return false;
+}
+
+void mpScaleX::SetLogAxis(bool log)
+{
+  if (m_win)
+    m_win->SetLogXaxis(log);
+}
+
+//-----------------------------------------------------------------------------
+// mpScaleY
+//-----------------------------------------------------------------------------
+
+IMPLEMENT_DYNAMIC_CLASS(mpScaleY, mpScale)
+
+/**
+ * Get the origin of axis and initialize the plot bondaries
+ */
+int mpScaleY::GetOrigin(mpWindow &w)
+{
+  int origin = 0;
+  // Get bondaries
+  m_plotBondaries = w.GetPlotBondaries(!m_drawOutsideMargins);
+
+  switch (m_flags)
+  {
+    // Scale Y : vertical axis
+    case mpALIGN_BORDER_LEFT:
+      origin = 1;
+      break;
+    case mpALIGN_LEFT:
+    {
+      if (m_drawOutsideMargins)
+        origin = Y_BORDER_SEPARATION;
+      else
+        origin = w.GetMarginLeft() - EXTRA_MARGIN - 1;
+      break;
+    }
     case mpALIGN_CENTERY:
       origin = w.x2p(0);
       if (!m_drawOutsideMargins && ((origin > (w.GetScreenX() - w.GetMarginRight())) || (origin + 1 < w.GetMarginLeft())))
@@ -2173,70 +3948,94 @@ void mpScaleY::DoPlot(wxDC &dc, mpWindow &w)
     fmt = m_labelFormat;
   }
 
-  double n = floor((posY - (double)(w.GetScreenY()) / scaleY) / step) * step;
+  // Integer tick index, as for the X axis
+  const double i0 = floor((posY - (double)(w.GetScreenY()) / scaleY) / step);
+  const double tickBase = posY - i0 * step;
+  double n = i0 * step;
 
   wxCoord tmp = 65536;
   wxCoord labelW = 0;
-  // Before staring cycle, calculate label height
-  wxCoord labelHeigth = 0;
   wxString s;
-  wxCoord tx = 0, ty = 0;
-  s.Printf(fmt, n);
-  dc.GetTextExtent(s, &tx, &labelHeigth);
-  labelHeigth /= 2;
+  const mpLabel* label;
+
+  // The labels are cached by tick index, for the format and the step
+  // Before staring cycle, calculate label height. It depends only on the font.
+  if (CheckLabelCache(wxString::Format(_T("%d|"), IsLogAxis()) + fmt, step))
+  {
+    wxCoord tx = 0;
+    s.Printf(fmt, n);
+    dc.GetTextExtent(s, &tx, &m_labelHeight);
+  }
+  const wxCoord labelHeigth = m_labelHeight / 2;
 
-  // Draw grid, ticks and label
-  for (; n < end; n += step)
+  // Collect grid and ticks
+  for (int i = 0; (n = (i0 + i) * step) < end; i++)
   {
     // To have a real zero
     if (fabs(n) < 1e-10)
       n = 0;
-    const int p = (int)((posY - n) * scaleY);
+    const int p = (int)((tickBase - i * step) * scaleY);
     if ((p > m_plotBondaries.startPy + labelHeigth) && (p < m_plotBondaries.endPy - labelHeigth))
     {
-      // Draw axis grids
+      // Axis grids
       if (m_grids && (n != 0))
       {
-        dc.SetPen(m_gridpen);
-        dc.DrawLine(m_plotBondaries.startPx + 1, p, m_plotBondaries.endPx - 1, p);
+        m_gridBegin.push_back(wxPoint(m_plotBondaries.startPx + 1, p));
+        m_gridEnd.push_back(wxPoint(m_plotBondaries.endPx - 1, p));
       }
 
-      // Draw axis ticks
+      // Axis ticks
       if (m_ticks)
       {
-        dc.SetPen(m_pen);
         if (m_flags == mpALIGN_BORDER_LEFT)
         {
-          dc.DrawLine(orgx, p, orgx + 4, p);
+          m_tickBegin.push_back(wxPoint(orgx, p));
+          m_tickEnd.push_back(wxPoint(orgx + 4, p));
         }
         else
         {
-          dc.DrawLine(orgx - 4, p, orgx, p);
+          m_tickBegin.push_back(wxPoint(orgx - 4, p));
+          m_tickEnd.push_back(wxPoint(orgx, p));
         }
       }
+    }
+  }
 
-      if (IsLogAxis())
+  DrawSegments(dc);
+
+  // Draw the labels over the grid
+  for (int i = 0; (n = (i0 + i) * step) < end; i++)
+  {
+    // To have a real zero
+    if (fabs(n) < 1e-10)
+      n = 0;
+    const int p = (int)((tickBase - i * step) * scaleY);
+    if ((p > m_plotBondaries.startPy + labelHeigth) && (p < m_plotBondaries.endPy - labelHeigth))
+    {
+      label = FindLabel((wxInt64)(i0 + i));
+      if (!label)
       {
-        s = FormatLogValue(n);
-        if (s.IsEmpty())
-          continue;
+        if (IsLogAxis())
+          s = FormatLogValue(n);
+        else
+          s.Printf(fmt, n);
+        label = AddLabel(dc, (wxInt64)(i0 + i), s);
       }
-      else
-        s.Printf(fmt, n);
+      if (label->text.IsEmpty())
+        continue;
 
       // Print ticks labels
-      dc.GetTextExtent(s, &tx, &ty);
 #ifdef MATHPLOT_DO_LOGGING
-      if (ty != labelHeigth)
-        wxLogMessage(_T("mpScaleY::Plot: ty(%d) and labelHeigth(%d) differ!"), ty, labelHeigth);
+      if (label->height != labelHeigth)
+        wxLogMessage(_T("mpScaleY::Plot: ty(%d) and labelHeigth(%d) differ!"), label->height, labelHeigth);
 #endif
-      labelW = (labelW <= tx) ? tx : labelW;
+      labelW = (labelW <= label->width) ? label->width : labelW;
       if ((tmp - p + labelHeigth) > MIN_Y_AXIS_LABEL_SEPARATION)
       {
         if ((m_flags == mpALIGN_BORDER_LEFT) || (m_flags == mpALIGN_RIGHT))
-          dc.DrawText(s, orgx + 4, p - ty / 2);
+          dc.DrawText(label->text, orgx + 4, p - label->height / 2);
         else
-          dc.DrawText(s, orgx - tx - 4, p - ty / 2);
+          dc.DrawText(label->text, orgx - label->width - 4, p - label->height / 2);
         tmp = p - labelHeigth;
       }
     }
@@ -2246,6 +4045,7 @@ void mpScaleY::DoPlot(wxDC &dc, mpWindow &w)
   DrawScaleName(dc, w, orgx, labelW);
 }
 
+
 bool mpScaleY::IsLogAxis()
 {
   if (m_win)
@@ -2279,6 +4079,7 @@ IMPLEMENT_DYNAMIC_CLASS(mpWindow, wxWindow)
 BEGIN_EVENT_TABLE(mpWindow, wxWindow)
 EVT_PAINT(mpWindow::OnPaint)
 EVT_SIZE(mpWindow::OnSize)
+EVT_IDLE(mpWindow::OnIdle)
 EVT_SCROLLWIN_THUMBTRACK(mpWindow::OnScrollThumbTrack)
 EVT_SCROLLWIN_PAGEUP(mpWindow::OnScrollPageUp)
 EVT_SCROLLWIN_PAGEDOWN(mpWindow::OnScrollPageDown)
@@ -2390,7 +4191,6 @@ mpWindow::~mpWindow()
   DelAllLayers(true, false);
 
   DeleteAndNull(m_buff_bmp);
-  DeleteAndNull(m_zoom_bmp);
   DeleteAndNull(m_Screenshot_bmp);
   DeleteAndNull(m_configWindow);
 }
@@ -2412,11 +4212,28 @@ void mpWindow::InitParameters()
   m_buff_bmp = NULL;
   m_Screenshot_bmp = NULL;
   m_enableDoubleBuffer = true;
+  m_renderPending = true;
+  m_enableZoomPreview = true;
+  m_motionPending = false;
+  m_layersBoundValid[0] = m_layersBoundValid[1] = m_layersBoundValid[2] = false;
+  m_layersBoundDirty[0] = m_layersBoundDirty[1] = m_layersBoundDirty[2] = false;
+  m_autoScaleYVisible = false;
+  m_autoRange = false;
+  m_autoRangeHeadroom = 0.25;
+  m_autoRangeHysteresis = 0.5;
+  m_autoRangeBoundValid = false;
+  m_updateDepth = 0;
+  m_updatePendingAll = false;
+  m_updatePendingLegend = false;
+  m_updatePendingConfig = false;
+  m_frame_posX = m_frame_posY = 0;
+  m_frame_scaleX = m_frame_scaleY = 1.0;
+  m_frame_posY2 = 0;
+  m_frame_scaleY2 = 1.0;
   m_enableMouseNavigation = true;
   m_mouseMovedAfterRightClick = false;
   m_movingInfoLayer = NULL;
   m_InfoCoords = NULL;
-  m_zoom_bmp = NULL;
   m_magnetize = false;
   m_enableScrollBars = false;
 
@@ -2493,6 +4310,10 @@ void mpWindow::OnMouseMove(wxMouseEvent &event)
     m_desired.Y2max += Ay2_units;
     m_desired.Y2min += Ay2_units;
 
+    // The cross follows the mouse
+    if (m_magnetize)
+      m_magnet.SetPosition(eventPoint);
+
     UpdateAll();
 
 #ifdef MATHPLOT_DO_LOGGING
@@ -2501,81 +4322,68 @@ void mpWindow::OnMouseMove(wxMouseEvent &event)
   }
   else
   {
-    wxClientDC dc(this);
+    // Keep only the last position, it will be processed on idle
+    m_motionEvent = event;
+    m_motionPending = true;
+    wxWakeUpIdle();
+  }
+  event.Skip();
+}
 
-    // First need to clean the plot.
-    if (m_magnetize && (!m_repainting))
-      m_magnet.ClearPlot(dc);
+void mpWindow::ProcessMouseMotion(wxMouseEvent &event)
+{
+  m_motionPending = false;
+
+  // The current mouse position
+  wxPoint eventPoint = wxPoint(event.GetX(), event.GetY());
 
-    // zoom select rectangle
-    if (event.m_leftDown)
+  // zoom select rectangle
+  if (event.m_leftDown)
+  {
+    wxPoint moveVector = eventPoint - m_mouseLClick;
+    if (m_movingInfoLayer == NULL)
     {
-      wxPoint moveVector = eventPoint - m_mouseLClick;
-      if (m_movingInfoLayer == NULL)
+      wxRect zoom_dim = wxRect(m_mouseLClick, wxSize(moveVector.x, moveVector.y));
+      if (zoom_dim.width < 0)
       {
-        // First : restaure stored bitmap
-        if (m_zoom_bmp)
-        {
-          wxMemoryDC m_coord_dc(&dc);
-          m_coord_dc.SelectObject(*m_zoom_bmp);
-          dc.Blit(m_zoom_oldDim.x, m_zoom_oldDim.y, m_zoom_oldDim.width, m_zoom_oldDim.height, &m_coord_dc, 0, 0);
-          m_coord_dc.SelectObject(wxNullBitmap);
-          DeleteAndNull(m_zoom_bmp);
-        }
-
-        // Second : store new bitmap
-        m_zoom_dim = wxRect(m_mouseLClick, wxSize(moveVector.x, moveVector.y));
-        if ((m_zoom_dim.width != 0) && (m_zoom_dim.height != 0))
-        {
-          if (m_zoom_dim.width < 0)
-          {
-            m_zoom_dim.x += m_zoom_dim.width;
-            m_zoom_dim.width = abs(m_zoom_dim.width);
-          }
-          if (m_zoom_dim.height < 0)
-          {
-            m_zoom_dim.y += m_zoom_dim.height;
-            m_zoom_dim.height = abs(m_zoom_dim.height);
-          }
-
-          m_zoom_bmp = new wxBitmap(m_zoom_dim.width, m_zoom_dim.height, dc);
-          wxMemoryDC m_coord_dc(&dc);
-          m_coord_dc.SelectObject(*m_zoom_bmp);
-          m_coord_dc.Blit(0, 0, m_zoom_dim.width, m_zoom_dim.height, &dc, m_zoom_dim.x, m_zoom_dim.y);
-          m_coord_dc.SelectObject(wxNullBitmap);
-          m_zoom_oldDim = m_zoom_dim;
-
-          // Draw the rectangle that focus the selected region
-          wxPen pen(*wxBLACK, 1, wxPENSTYLE_DOT);  // wxDOT
-          dc.SetPen(pen);
-          dc.SetBrush(*wxTRANSPARENT_BRUSH);
-          dc.DrawRectangle(m_zoom_dim);
-        }
-
-        if (m_magnetize && (!m_repainting))
-          m_magnet.Plot(dc, eventPoint);
+        zoom_dim.x += zoom_dim.width;
+        zoom_dim.width = abs(zoom_dim.width);
       }
-      else
-        m_movingInfoLayer->Move(moveVector);
-    }
-    else
-    {
-      // Mouse move coordinate
-      if (m_InfoCoords && m_InfoCoords->IsVisible())
+      if (zoom_dim.height < 0)
       {
-        m_InfoCoords->UpdateInfo(*this, event);
-        m_InfoCoords->Plot(dc, *this);
+        zoom_dim.y += zoom_dim.height;
+        zoom_dim.height = abs(zoom_dim.height);
       }
+      m_zoomBox.SetBox(zoom_dim);
 
-      if (m_magnetize && (!m_repainting) && (event.GetEventType() == wxEVT_MOTION))
-        m_magnet.Plot(dc, eventPoint);
+      if (m_magnetize)
+        m_magnet.Plot(eventPoint);
     }
+    else
+      m_movingInfoLayer->Move(moveVector);
   }
-  event.Skip();
+  else
+  {
+    // Mouse move coordinate
+    if (m_InfoCoords && m_InfoCoords->IsVisible())
+    {
+      m_InfoCoords->UpdateInfo(*this, event);
+      m_InfoCoords->ShowOverlay(true);
+    }
+
+    if (m_magnetize && (event.GetEventType() == wxEVT_MOTION))
+      m_magnet.Plot(eventPoint);
+  }
+
+  RefreshOverlays();
 }
 
 void mpWindow::OnMouseLeftRelease(wxMouseEvent &event)
 {
+  // Process the last position before release
+  if (m_motionPending)
+    ProcessMouseMotion(m_motionEvent);
+
   if (m_movingInfoLayer != NULL)
   {
     m_movingInfoLayer->UpdateReference();
@@ -2583,7 +4391,8 @@ void mpWindow::OnMouseLeftRelease(wxMouseEvent &event)
   }
   else
   {
-    DeleteAndNull(m_zoom_bmp);
+    m_zoomBox.SetBox(wxRect());
+    RefreshOverlays();
     wxPoint release(event.GetX(), event.GetY());
     // Zoom if we have a real rectangle
     if ((release.x != m_mouseLClick.x) && (release.y != m_mouseLClick.y))
@@ -2644,23 +4453,13 @@ void mpWindow::OnMouseWheel(wxMouseEvent &event)
  */
 void mpWindow::OnMouseLeave(wxMouseEvent &WXUNUSED(event))
 {
-  wxClientDC dc(this);
-  if (m_InfoCoords && m_InfoCoords->IsVisible())
-  {
-    m_InfoCoords->ErasePlot(dc, *this);
-  }
-  if (m_zoom_bmp)
-  {
-    wxMemoryDC m_coord_dc(&dc);
-    m_coord_dc.SelectObject(*m_zoom_bmp);
-    dc.Blit(m_zoom_oldDim.x, m_zoom_oldDim.y, m_zoom_oldDim.width, m_zoom_oldDim.height, &m_coord_dc, 0, 0);
-    m_coord_dc.SelectObject(wxNullBitmap);
-    DeleteAndNull(m_zoom_bmp);
-  }
-  if (m_magnetize)
-  {
-    m_magnet.ClearPlot(dc);
-  }
+  // A motion still waiting for idle would show the overlays again
+  m_motionPending = false;
+  if (m_InfoCoords)
+    m_InfoCoords->ShowOverlay(false);
+  m_zoomBox.SetBox(wxRect());
+  m_magnet.ClearPlot();
+  RefreshOverlays();
 }
 
 /**
@@ -2669,19 +4468,13 @@ void mpWindow::OnMouseLeave(wxMouseEvent &WXUNUSED(event))
  */
 void mpWindow::Fit()
 {
-  UpdateBBox();
+  UpdateBBox(true);
   Fit(m_bound);
 }
 
 // JL
 void mpWindow::Fit(const mpFloatRect &rect, wxCoord *printSizeX, wxCoord *printSizeY)
 {
-  if (m_magnetize)
-  {
-    // Avoid paint cross if mouse move
-    m_repainting = true;
-  }
-
   // Save desired borders:
   m_desired = rect;
 
@@ -2873,18 +4666,21 @@ void mpWindow::Zoom(bool zoomIn, const wxPoint &centerPoint)
       prior_layer_x, prior_layer_y, p2x(c.x), p2y(c.y));
 #endif
   UpdateAll();
+  ZoomPreview();
 }
 
 void mpWindow::ZoomInX()
 {
   m_scaleX *= zoomIncrementalFactor;
   UpdateAll();
+  ZoomPreview();
 }
 
 void mpWindow::ZoomOutX()
 {
   m_scaleX /= zoomIncrementalFactor;
   UpdateAll();
+  ZoomPreview();
 }
 
 void mpWindow::ZoomInY()
@@ -2892,6 +4688,7 @@ void mpWindow::ZoomInY()
   m_scaleY *= zoomIncrementalFactor;
   m_scaleY2 *= zoomIncrementalFactor;
   UpdateAll();
+  ZoomPreview();
 }
 
 void mpWindow::ZoomOutY()
@@ -2899,6 +4696,7 @@ void mpWindow::ZoomOutY()
   m_scaleY /= zoomIncrementalFactor;
   m_scaleY2 /= zoomIncrementalFactor;
   UpdateAll();
+  ZoomPreview();
 }
 
 void mpWindow::ZoomRect(wxPoint p0, wxPoint p1)
@@ -2925,6 +4723,7 @@ void mpWindow::ZoomRect(wxPoint p0, wxPoint p1)
 #endif
 
   Fit(zoom);
+  ZoomPreview();
 }
 
 void mpWindow::LockAspect(bool enable)
@@ -3070,9 +4869,6 @@ bool mpWindow::AddLayer(mpLayer *layer, bool refreshDisplay)
     mpScaleType scale;
     mpFunctionType function;
 
-    // add the layer to the layer list
-    m_layers.push_back(layer);
-
     if (layer->IsInfo(&info) && (info == mpiCoords))
     {
       // Only one info coords is allowed
@@ -3081,6 +4877,18 @@ bool mpWindow::AddLayer(mpLayer *layer, bool refreshDisplay)
       m_InfoCoords = (mpInfoCoords*)layer;
     }
 
+    // add the layer to the layer list
+    m_layers.push_back(layer);
+    IndexLayer(layer);
+
+    // The bounding box will be added at the next UpdateBBox
+    mpLayerBBox bbox;
+    bbox.valid = false;
+    bbox.isY2 = false;
+    bbox.changed = true;
+    m_layersBBox[layer] = bbox;
+    m_layersBBoxChanged.push_back(layer);
+
     if (layer->IsScale(&scale))
     {
       if ((scale == mpsScaleX) && (m_XAxis == NULL))
@@ -3109,9 +4917,14 @@ bool mpWindow::AddLayer(mpLayer *layer, bool refreshDisplay)
     // We just add a function, so we need to update the legend
     if (layer->IsFunction(&function))
     {
-      mpInfoLegend* legend = (mpInfoLegend*)this->GetLayerByClassName(_T("mpInfoLegend"));
-      if (legend)
-        legend->SetNeedUpdate();
+      if (m_updateDepth > 0)
+        m_updatePendingLegend = true;
+      else
+      {
+        mpInfoLegend* legend = (mpInfoLegend*)this->GetLayerByClassName(_T("mpInfoLegend"));
+        if (legend)
+          legend->SetNeedUpdate();
+      }
     }
 
     layer->SetWindow(*this);
@@ -3125,6 +4938,50 @@ bool mpWindow::AddLayer(mpLayer *layer, bool refreshDisplay)
   return false;
 }
 
+bool mpWindow::AddLayers(const std::vector<mpLayer*> &layers, bool refreshDisplay)
+{
+  bool result = true;
+
+  BeginUpdate();
+  for (std::vector<mpLayer*>::const_iterator it = layers.begin(); it != layers.end(); it++)
+  {
+    if (!AddLayer(*it, false))
+      result = false;
+  }
+  if (refreshDisplay)
+    UpdateAll();
+  EndUpdate();
+
+  return result;
+}
+
+void mpWindow::EndUpdate()
+{
+  if (m_updateDepth == 0)
+    return;
+  if (--m_updateDepth > 0)
+    return;
+
+  // The batch is finished : do the refresh once
+  if (m_updatePendingLegend)
+  {
+    m_updatePendingLegend = false;
+    mpInfoLegend* legend = (mpInfoLegend*)this->GetLayerByClassName(_T("mpInfoLegend"));
+    if (legend)
+      legend->SetNeedUpdate();
+  }
+  if (m_updatePendingAll)
+  {
+    m_updatePendingAll = false;
+    UpdateAll();
+  }
+  if (m_updatePendingConfig)
+  {
+    m_updatePendingConfig = false;
+    RefreshConfigWindow();
+  }
+}
+
 bool mpWindow::DelLayer(mpLayer *layer, bool alsoDeleteObject, bool refreshDisplay)
 {
   for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
@@ -3151,9 +5008,13 @@ bool mpWindow::DelLayer(mpLayer *layer, bool alsoDeleteObject, bool refreshDispl
           if (((mpScaleY*)layer)->IsY2Axis())
             Update_CountY2Axis(false);
         }
+        UnindexLayer(layer);
+        RemoveLayerBBox(layer);
         // Also delete the object?
         if (alsoDeleteObject)
           delete *it;
+        else
+          layer->ResetWindow();
         m_layers.erase(it); // this deleted the reference only
         if (refreshDisplay)
           UpdateAll();
@@ -3164,241 +5025,835 @@ bool mpWindow::DelLayer(mpLayer *layer, bool alsoDeleteObject, bool refreshDispl
         return false;
     }
   }
-  return false;
+  return false;
+}
+
+void mpWindow::DelAllLayers(bool alsoDeleteObject, bool refreshDisplay)
+{
+  // Also delete the object?
+  for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+  {
+    if (alsoDeleteObject)
+      delete *it;
+    else
+      (*it)->ResetWindow();
+  }
+  m_layers.clear(); // this deleted the reference only
+  for (int i = mpZIndex_BACKGROUND; i < mpZIndex_END; i++)
+    m_layersZ[i].clear();
+  m_layersByName.clear();
+  m_layersByClass.clear();
+  m_layersBBox.clear();
+  m_layersBBoxChanged.clear();
+  m_layersBoundValid[0] = m_layersBoundValid[1] = m_layersBoundValid[2] = false;
+  m_InfoCoords = NULL;
+  m_movingInfoLayer = NULL;
+  m_XAxis = NULL;
+  m_YAxis = NULL;
+  m_countY2Axis = 0;
+  if (refreshDisplay)
+    UpdateAll();
+  DeleteAndNull(m_configWindow);
+}
+
+void mpWindow::DelAllPlot(bool alsoDeleteObject, mpFunctionType func, bool refreshDisplay)
+{
+  mpFunctionType function;
+
+  // First the list of the layers to delete, since DelLayer modify m_layers
+  std::vector<mpLayer*> toDelete;
+  for (wxLayerList::reverse_iterator it = m_layers.rbegin(); it != m_layers.rend(); it++)
+  {
+    if ((*it)->IsFunction(&function) && ((func == mpfAllType) || (function == func)))
+      toDelete.push_back(*it);
+  }
+
+  BeginUpdate();
+  for (std::vector<mpLayer*>::iterator it = toDelete.begin(); it != toDelete.end(); it++)
+    DelLayer(*it, alsoDeleteObject, false);
+  if (refreshDisplay)
+    UpdateAll();
+  RefreshConfigWindow();
+  EndUpdate();
+}
+
+void mpWindow::OnPaint(wxPaintEvent &WXUNUSED(event))
+{
+#ifdef _WIN32
+  wxPaintDC dc(this);
+#else
+  wxAutoBufferedPaintDC dc(this);
+#endif
+  int h, w;
+  dc.GetSize(&w, &h);   // This is the size of the visible area only!
+  SetScreen(w, h);
+
+#ifdef MATHPLOT_DO_LOGGING
+  {
+    int px = 0, py = 0;
+//    GetViewStart( &px, &py );
+    wxLogMessage(_T("[mpWindow::OnPaint] vis.area:%ix%i px=%i py=%i"), m_scrX, m_scrY, px, py);
+  }
+#endif
+
+  // J.L.Blanco @ Aug 2007: Added double buffer support
+  if (m_enableDoubleBuffer)
+  {
+    // No frame available with the right size : we can not wait for the idle render
+    if ((m_buff_bmp == NULL) || (m_last_lx != m_scrX) || (m_last_ly != m_scrY))
+      RenderFrame();
+
+    // Draw the last frame to the window. It is stretched if a new frame is pending.
+    BlitFrame(dc);
+  }
+  else
+  {
+    m_repainting = true;
+    DrawAll(dc);
+    m_renderPending = false;
+    SaveOverlayAreas(dc);
+  }
+
+  // Draw the cross, the zoom box, the info coordinates, ...
+  DrawOverlays(dc);
+
+  m_repainting = false;
+}
+
+void mpWindow::OnIdle(wxIdleEvent &event)
+{
+  // Process only the last mouse motion, all the previous positions are discarded
+  if (m_motionPending)
+    ProcessMouseMotion(m_motionEvent);
+
+  // Render only the last requested view, all the previous requests are discarded
+  if (m_renderPending && m_enableDoubleBuffer && IsShownOnScreen())
+  {
+    RenderFrame();
+    Refresh(false);
+  }
+  event.Skip();
+}
+
+void mpWindow::DrawAll(wxDC &dc)
+{
+  // Draw background
+  // Clean the screen
+  dc.Clear();
+  if (m_drawBox)
+    dc.SetPen(*wxBLACK);
+  else
+    dc.SetPen(*wxTRANSPARENT_PEN);
+  dc.SetBrush(*wxWHITE_BRUSH);
+  dc.DrawRectangle(0, 0, m_scrX, m_scrY);
+
+  // Draw background plot area
+  dc.SetBrush(m_bgColour);
+  dc.SetTextForeground(m_fgColour);
+  dc.DrawRectangle(m_margin.left - EXTRA_MARGIN, m_margin.top - EXTRA_MARGIN,
+      m_plotWidth + 2*EXTRA_MARGIN, m_plotHeight + 2*EXTRA_MARGIN);
+
+  // Draw all the layers in Z order
+  for (int i = mpZIndex_BACKGROUND; i < mpZIndex_END; i++)
+  {
+    for (wxLayerList::iterator it = m_layersZ[i].begin(); it != m_layersZ[i].end(); it++)
+    {
+      // The info coordinates are drawn above the frame, as an overlay
+      if (*it != m_InfoCoords)
+        (*it)->Plot(dc, *this);
+    }
+  }
+}
+
+void mpWindow::RenderFrame()
+{
+  wxClientDC dc(this);
+  int h, w;
+  GetClientSize(&w, &h);
+  SetScreen(w, h);
+
+  m_repainting = true;
+
+  // Recreate Bitmap if sizes have changed
+  if ((m_buff_bmp == NULL) || (m_last_lx != m_scrX) || (m_last_ly != m_scrY))
+  {
+    DeleteAndNull(m_buff_bmp);
+    m_buff_bmp = new wxBitmap(m_scrX, m_scrY, dc);
+    m_last_lx = m_scrX;
+    m_last_ly = m_scrY;
+  }
+
+  wxMemoryDC buff_dc(&dc);
+  buff_dc.SelectObject(*m_buff_bmp);
+  DrawAll(buff_dc);
+  buff_dc.SelectObject(wxNullBitmap);
+
+  // Keep in mind the view of this frame
+  m_frame_posX = m_posX;
+  m_frame_posY = m_posY;
+  m_frame_scaleX = m_scaleX;
+  m_frame_scaleY = m_scaleY;
+  m_frame_posY2 = m_posY2;
+  m_frame_scaleY2 = m_scaleY2;
+  m_renderPending = false;
+}
+
+void mpWindow::BlitFrame(wxDC &dc)
+{
+  wxMemoryDC buff_dc(&dc);
+  buff_dc.SelectObject(*m_buff_bmp);
+
+  // Ratio between the current scale and the frame scale
+  double kx = m_scaleX / m_frame_scaleX;
+  double ky = m_scaleY / m_frame_scaleY;
+  // Position of the frame origin in the current view
+  double ox = (m_frame_posX - m_posX) * m_scaleX;
+  double oy = (m_posY - m_frame_posY) * m_scaleY;
+
+  // The layers on the Y2 axis can only be stretched with the others if both Y axis moved the same way
+  bool stretchY2 = true;
+  if (Y2AxisExist())
+  {
+    double ky2 = m_scaleY2 / m_frame_scaleY2;
+    double oy2 = (m_posY2 - m_frame_posY2) * m_scaleY2;
+    stretchY2 = (fabs(oy2 - oy) < 1) && (fabs((ky2 - ky) * m_last_ly) < 1);
+  }
+
+  bool sameView = (m_frame_posX == m_posX) && (m_frame_posY == m_posY) && (m_frame_scaleX == m_scaleX) &&
+      (m_frame_scaleY == m_scaleY) && (m_frame_posY2 == m_posY2) && (m_frame_scaleY2 == m_scaleY2);
+
+  if (sameView)
+  {
+    dc.Blit(0, 0, m_scrX, m_scrY, &buff_dc, 0, 0, wxCOPY);
+  }
+  else
+  {
+    // The view has changed since the last frame : a new frame is needed
+    if (!m_renderPending)
+    {
+      m_renderPending = true;
+      wxWakeUpIdle();
+    }
+
+    if (!stretchY2)
+    {
+      // No stretch can match both Y axis : keep the frame unchanged until the new one is rendered
+      dc.Blit(0, 0, m_scrX, m_scrY, &buff_dc, 0, 0, wxCOPY);
+      buff_dc.SelectObject(wxNullBitmap);
+      return;
+    }
+
+    // The margins with the axis are kept unchanged, only the plot area is stretched
+    dc.Blit(0, 0, m_scrX, m_scrY, &buff_dc, 0, 0, wxCOPY);
+    const double plotRight = m_margin.left + m_plotWidth;
+    const double plotBottom = m_margin.top + m_plotHeight;
+
+    // Visible part of the frame in the plot area of the current view
+    double left = (ox > m_margin.left) ? ox : m_margin.left;
+    double top = (oy > m_margin.top) ? oy : m_margin.top;
+    double right = ox + m_last_lx * kx;
+    double bottom = oy + m_last_ly * ky;
+    if (right > plotRight)
+      right = plotRight;
+    if (bottom > plotBottom)
+      bottom = plotBottom;
+
+    // Plot area not covered by the frame
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.SetBrush(m_bgColour);
+    dc.DrawRectangle(m_margin.left, m_margin.top, m_plotWidth, m_plotHeight);
+
+    if ((right - left >= 1) && (bottom - top >= 1))
+    {
+      wxCoord srcW = (wxCoord)((right - left) / kx);
+      wxCoord srcH = (wxCoord)((bottom - top) / ky);
+      dc.StretchBlit((wxCoord)left, (wxCoord)top, (wxCoord)(right - left), (wxCoord)(bottom - top), &buff_dc,
+          (wxCoord)((left - ox) / kx), (wxCoord)((top - oy) / ky), (srcW > 0) ? srcW : 1, (srcH > 0) ? srcH : 1, wxCOPY);
+    }
+  }
+
+  buff_dc.SelectObject(wxNullBitmap);
+}
+
+void mpWindow::ZoomPreview()
+{
+  // Nothing to stretch, or the new frame is already rendered
+  if (!m_enableZoomPreview || !m_enableDoubleBuffer || (m_buff_bmp == NULL) || !m_renderPending || !IsShownOnScreen())
+    return;
+
+  int h, w;
+  GetClientSize(&w, &h);
+  // The size has changed : the frame can not be used
+  if ((m_last_lx != w) || (m_last_ly != h))
+    return;
+
+  // Paint now : OnPaint shows the stretched frame and the overlays, until the new frame is rendered on idle
+  Refresh(false);
+  Update();
+}
+
+void mpWindow::CollectOverlays()
+{
+  m_overlayList.clear();
+  m_overlayList.push_back(&m_zoomBox);
+  if (m_InfoCoords)
+    m_overlayList.push_back(m_InfoCoords);
+  if (m_magnetize)
+    m_overlayList.push_back(&m_magnet);
+  m_overlayList.insert(m_overlayList.end(), m_overlays.begin(), m_overlays.end());
+}
+
+void mpWindow::DrawOverlays(wxDC &dc)
+{
+  CollectOverlays();
+  m_overlayDrawn.clear();
+  for (std::vector<mpOverlay*>::iterator it = m_overlayList.begin(); it != m_overlayList.end(); it++)
+  {
+    if ((*it)->IsOverlayShown())
+    {
+      (*it)->GetOverlayRects(dc, *this, m_overlayDrawn);
+      (*it)->DrawOverlay(dc, *this);
+    }
+  }
+}
+
+void mpWindow::RefreshOverlays()
+{
+  // Without double buffer, there is no frame : erase the overlays with the saved screen areas
+  if (!m_enableDoubleBuffer)
+  {
+    if (!IsShownOnScreen())
+      return;
+
+    wxClientDC dc(this);
+    for (std::deque<mpBackingStore>::reverse_iterator it = m_screen_stores.rbegin(); it != m_screen_stores.rend(); it++)
+      it->Restore(dc);
+    SaveOverlayAreas(dc);
+    for (std::vector<mpOverlay*>::iterator it = m_overlayList.begin(); it != m_overlayList.end(); it++)
+    {
+      if ((*it)->IsOverlayShown())
+        (*it)->DrawOverlay(dc, *this);
+    }
+    m_overlayDrawn.swap(m_overlayRects);
+    return;
+  }
+
+  // A new frame is pending : the overlays will be drawn with it
+  if ((m_buff_bmp == NULL) || m_renderPending || !IsShownOnScreen())
+    return;
+
+  wxClientDC dc(this);
+  CollectOverlays();
+
+  // The new areas of the overlays
+  m_overlayRects.clear();
+  for (std::vector<mpOverlay*>::iterator it = m_overlayList.begin(); it != m_overlayList.end(); it++)
+  {
+    if ((*it)->IsOverlayShown())
+      (*it)->GetOverlayRects(dc, *this, m_overlayRects);
+  }
+
+  // Compose the old and new areas : the frame, then the overlays above
+  wxMemoryDC frame_dc(&dc);
+  frame_dc.SelectObject(*m_buff_bmp);
+  wxRect screen(0, 0, m_scrX, m_scrY);
+  size_t nbDrawn = m_overlayDrawn.size();
+  for (size_t i = 0; i < nbDrawn + m_overlayRects.size(); i++)
+  {
+    wxRect area = (i < nbDrawn) ? m_overlayDrawn[i] : m_overlayRects[i - nbDrawn];
+    // Some margin for the pen width
+    area.Inflate(1, 1);
+    area = area.Intersect(screen);
+    if (area.IsEmpty())
+      continue;
+
+    m_overlay_store.Save(frame_dc, area);
+    wxDC &overlay_dc = m_overlay_store.GetDC();
+    overlay_dc.SetDeviceOrigin(-area.x, -area.y);
+    overlay_dc.SetClippingRegion(area);
+    for (std::vector<mpOverlay*>::iterator it = m_overlayList.begin(); it != m_overlayList.end(); it++)
+    {
+      if ((*it)->IsOverlayShown())
+        (*it)->DrawOverlay(overlay_dc, *this);
+    }
+    overlay_dc.DestroyClippingRegion();
+    overlay_dc.SetDeviceOrigin(0, 0);
+    m_overlay_store.Restore(dc);
+  }
+  frame_dc.SelectObject(wxNullBitmap);
+
+  m_overlayDrawn.swap(m_overlayRects);
+}
+
+void mpWindow::SaveOverlayAreas(wxDC &dc)
+{
+  CollectOverlays();
+  m_overlayRects.clear();
+  for (std::vector<mpOverlay*>::iterator it = m_overlayList.begin(); it != m_overlayList.end(); it++)
+  {
+    if ((*it)->IsOverlayShown())
+      (*it)->GetOverlayRects(dc, *this, m_overlayRects);
+  }
+
+  // All the areas are saved before any overlay is drawn, so they can overlap
+  wxRect screen(0, 0, m_scrX, m_scrY);
+  while (m_screen_stores.size() < m_overlayRects.size())
+    m_screen_stores.emplace_back();
+  for (size_t i = 0; i < m_screen_stores.size(); i++)
+  {
+    m_screen_stores[i].Invalidate();
+    if (i >= m_overlayRects.size())
+      continue;
+    // Some margin for the pen width
+    wxRect area = m_overlayRects[i];
+    area.Inflate(1, 1);
+    area = area.Intersect(screen);
+    if (!area.IsEmpty())
+      m_screen_stores[i].Save(dc, area);
+  }
+}
+
+void mpWindow::AddOverlay(mpOverlay *overlay, bool refreshDisplay)
+{
+  if (overlay == NULL)
+    return;
+  m_overlays.push_back(overlay);
+  if (refreshDisplay)
+    RefreshOverlays();
+}
+
+void mpWindow::DelOverlay(mpOverlay *overlay, bool refreshDisplay)
+{
+  for (std::vector<mpOverlay*>::iterator it = m_overlays.begin(); it != m_overlays.end(); it++)
+  {
+    if (*it == overlay)
+    {
+      m_overlays.erase(it);
+      if (refreshDisplay)
+        RefreshOverlays();
+      return;
+    }
+  }
+}
+
+void mpWindow::SetMPScrollbars(bool status)
+{
+  // Temporary behaviour: always disable scrollbars
+  m_enableScrollBars = status; //false;
+  if (status == false)
+  {
+    SetScrollbar(wxHORIZONTAL, 0, 0, 0);
+    SetScrollbar(wxVERTICAL, 0, 0, 0);
+  }
+  // else the scroll bars will be updated in UpdateAll();
+  UpdateAll();
+}
+
+void mpWindow::SetBound()
+{
+  bool HaveXAxis = (m_XAxis && (!m_XAxis->GetAuto()));
+  bool HaveYAxis = (m_YAxis && (!m_YAxis->GetAuto()));
+
+  if (HaveXAxis || HaveYAxis)
+  {
+    mpFunctionType function;
+    for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+    {
+      if ((*it)->IsFunction(&function))
+      {
+        if ((function == mpfFX) && HaveXAxis)
+        {
+          m_bound.Ymin = ((mpFX*)(*it))->GetY(m_XAxis->GetMinScale());
+          m_bound.Ymax = ((mpFX*)(*it))->GetY(m_XAxis->GetMaxScale());
+        }
+        else
+          if ((function == mpfFY) && HaveYAxis)
+          {
+            m_bound.Xmin = ((mpFY*)(*it))->GetX(m_YAxis->GetMinScale());
+            m_bound.Xmax = ((mpFY*)(*it))->GetX(m_YAxis->GetMaxScale());
+          }
+      }
+    }
+  }
+}
+
+/**
+ * Get the bounding of all visible series
+ */
+void mpWindow::QueryLayerBBox(mpLayer *layer, mpLayerBBox &bbox)
+{
+  mpFunctionType function;
+  bbox.valid = layer->HasBBox() && layer->IsVisible();
+  if (bbox.valid)
+  {
+    layer->GetBBox(&bbox.bound);
+    bbox.isY2 = (layer->IsFunction(&function)) && (((mpFunction*)layer)->GetY2Axis());
+  }
+}
+
+/**
+ * Update a range of the global bounding box with the change of a layer.
+ * If the old extent of the layer was perhaps a limit of the range, the range is marked dirty
+ * to be recomputed from the cache, otherwise the range is just extended with the new extent.
+ */
+static void UpdateBBoxRange(double &rangeMin, double &rangeMax, bool &rangeValid, bool &rangeDirty, bool oldValid, double oldMin,
+    double oldMax, bool newValid, double newMin, double newMax)
+{
+  if (rangeDirty)
+    return;
+
+  // The range can shrink
+  if (oldValid && rangeValid
+      && (((oldMin <= rangeMin) && !(newValid && (newMin <= oldMin))) || ((oldMax >= rangeMax) && !(newValid && (newMax >= oldMax)))))
+  {
+    rangeDirty = true;
+    return;
+  }
+
+  if (newValid)
+  {
+    if (!rangeValid)
+    {
+      rangeMin = newMin;
+      rangeMax = newMax;
+      rangeValid = true;
+    }
+    else
+    {
+      if (newMin < rangeMin)
+        rangeMin = newMin;
+      if (newMax > rangeMax)
+        rangeMax = newMax;
+    }
+  }
+}
+
+void mpWindow::ApplyLayerBBox(const mpLayerBBox &oldBBox, const mpLayerBBox &newBBox)
+{
+  // X axis
+  UpdateBBoxRange(m_layersBound.Xmin, m_layersBound.Xmax, m_layersBoundValid[0], m_layersBoundDirty[0], oldBBox.valid,
+      oldBBox.bound.Xmin, oldBBox.bound.Xmax, newBBox.valid, newBBox.bound.Xmin, newBBox.bound.Xmax);
+  // Y axis
+  UpdateBBoxRange(m_layersBound.Ymin, m_layersBound.Ymax, m_layersBoundValid[1], m_layersBoundDirty[1], oldBBox.valid && !oldBBox.isY2,
+      oldBBox.bound.Ymin, oldBBox.bound.Ymax, newBBox.valid && !newBBox.isY2, newBBox.bound.Ymin, newBBox.bound.Ymax);
+  // Y2 axis
+  UpdateBBoxRange(m_layersBound.Y2min, m_layersBound.Y2max, m_layersBoundValid[2], m_layersBoundDirty[2], oldBBox.valid && oldBBox.isY2,
+      oldBBox.bound.Ymin, oldBBox.bound.Ymax, newBBox.valid && newBBox.isY2, newBBox.bound.Ymin, newBBox.bound.Ymax);
+}
+
+void mpWindow::LayerBBoxChanged(mpLayer *layer)
+{
+  mpLayerBBoxMap::iterator it = m_layersBBox.find(layer);
+  // Only the attached layers, and only once
+  if ((it != m_layersBBox.end()) && !it->second.changed)
+  {
+    it->second.changed = true;
+    m_layersBBoxChanged.push_back(layer);
+  }
+}
+
+void mpWindow::RemoveLayerBBox(mpLayer *layer)
+{
+  mpLayerBBoxMap::iterator it = m_layersBBox.find(layer);
+  if (it == m_layersBBox.end())
+    return;
+
+  if (it->second.changed)
+  {
+    for (std::vector<mpLayer*>::iterator itc = m_layersBBoxChanged.begin(); itc != m_layersBBoxChanged.end(); itc++)
+    {
+      if (*itc == layer)
+      {
+        m_layersBBoxChanged.erase(itc);
+        break;
+      }
+    }
+  }
+
+  mpLayerBBox removed;
+  removed.valid = false;
+  ApplyLayerBBox(it->second, removed);
+  m_layersBBox.erase(it);
+}
+
+void mpWindow::AutoScaleYVisible()
+{
+  // The visible X range
+  double xmin = p2x(m_margin.left);
+  double xmax = p2x(m_margin.left + m_plotWidth);
+  if (m_LogXaxis)
+  {
+    xmin = pow(10, xmin);
+    xmax = pow(10, xmax);
+  }
+
+  // Y extent of the series in this range
+  mpFloatRect extent;
+  bool validY = false, validY2 = false;
+  mpFunctionType function;
+  for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+  {
+    double ymin, ymax;
+    if (!((*it)->IsVisible() && (*it)->HasBBox() && (*it)->IsFunction(&function)))
+      continue;
+    mpFunction* f = (mpFunction*)(*it);
+    if (!f->GetYRange(xmin, xmax, &ymin, &ymax))
+      continue;
+
+    // On a log axis, the values <= 0 are not drawn: skip them. The smallest positive value is not known
+    // when ymin <= 0, so the layer only gives its maximum.
+    if (m_LogYaxis)
+    {
+      if (ymax <= 0)
+        continue;
+      ymax = log10(ymax);
+      ymin = (ymin > 0) ? log10(ymin) : ymax;
+    }
+
+    if (f->GetY2Axis())
+    {
+      extent.Y2min = validY2 ? wxMin(extent.Y2min, ymin) : ymin;
+      extent.Y2max = validY2 ? wxMax(extent.Y2max, ymax) : ymax;
+      validY2 = true;
+    }
+    else
+    {
+      extent.Ymin = validY ? wxMin(extent.Ymin, ymin) : ymin;
+      extent.Ymax = validY ? wxMax(extent.Ymax, ymax) : ymax;
+      validY = true;
+    }
+  }
+
+  // A flat range on a log axis shows the decade below
+  if (m_LogYaxis)
+  {
+    if (validY && (extent.Ymin == extent.Ymax))
+      extent.Ymin -= 1;
+    if (validY2 && (extent.Y2min == extent.Y2max))
+      extent.Y2min -= 1;
+  }
+
+  // Same adjustments as in Fit
+  if (validY)
+  {
+    double Ay = extent.Ymax - extent.Ymin;
+    m_scaleY = ISNOTNULL(Ay) ? m_plotHeight / Ay : 1;
+    m_posY = (extent.Ymin + extent.Ymax) / 2 + (m_plotHeight / 2 + m_margin.top) / m_scaleY;
+    m_desired.Ymin = extent.Ymin;
+    m_desired.Ymax = extent.Ymax;
+  }
+  if (validY2)
+  {
+    double Ay2 = extent.Y2max - extent.Y2min;
+    m_scaleY2 = ISNOTNULL(Ay2) ? m_plotHeight / Ay2 : 1;
+    m_posY2 = (extent.Y2min + extent.Y2max) / 2 + (m_plotHeight / 2 + m_margin.top) / m_scaleY2;
+    m_desired.Y2min = extent.Y2min;
+    m_desired.Y2max = extent.Y2max;
+  }
 }
 
-void mpWindow::DelAllLayers(bool alsoDeleteObject, bool refreshDisplay)
+// Block size of the pixel conversion: a fixed inner count lets the compiler vectorize it with its default cost model
+#define mpPIXELS_BLOCK 8
+
+/** Convert to pixels: pixel = (origin + value - pos) * scale, clamped. Without log, the loop has no branch
+ and no call; it is done by blocks of mpPIXELS_BLOCK values, so the inner loop is vectorized at the usual
+ optimization level (checked with GCC 12 -O2 -fopt-info-vec), and the remainder is done value by value.
+ The values are relative to origin: (origin - pos) is computed once, and is small compared to origin when
+ the view is near the data, so the precision of the values is kept for large coordinates. */
+template <bool log>
+static void ValuesToPixels(const double *values, wxCoord *pixels, size_t n, double origin, double pos, double scale)
 {
-  while (m_layers.size() > 0)
+  const double shift = log ? -pos : origin - pos;
+  size_t i = 0;
+  for (; i + mpPIXELS_BLOCK <= n; i += mpPIXELS_BLOCK)
   {
-    // Also delete the object?
-    if (alsoDeleteObject)
-      delete m_layers[0];
-    m_layers.erase(m_layers.begin()); // this deleted the reference only
+    for (size_t j = 0; j < mpPIXELS_BLOCK; j++)
+      pixels[i + j] = (wxCoord)ClampCoord(((log ? log10(origin + values[i + j]) : values[i + j]) + shift) * scale);
   }
-  m_InfoCoords = NULL;
-  m_movingInfoLayer = NULL;
-  m_XAxis = NULL;
-  m_YAxis = NULL;
-  m_countY2Axis = 0;
-  if (refreshDisplay)
-    UpdateAll();
-  DeleteAndNull(m_configWindow);
+  for (; i < n; i++)
+    pixels[i] = (wxCoord)ClampCoord(((log ? log10(origin + values[i]) : values[i]) + shift) * scale);
 }
 
-void mpWindow::DelAllPlot(bool alsoDeleteObject, mpFunctionType func, bool refreshDisplay)
+void mpWindow::x2pArray(const double *xs, wxCoord *pxs, size_t n, bool log, double origin) const
 {
-  mpFunctionType function;
-  for (wxLayerList::reverse_iterator it = m_layers.rbegin(); it != m_layers.rend(); it++)
-  {
-    if ((*it)->IsFunction(&function) && ((func == mpfAllType) || (function == func)))
-    {
-      DelLayer((mpLayer*)(*it), alsoDeleteObject, false);
-    }
-  }
-  if (refreshDisplay)
-    UpdateAll();
-  RefreshConfigWindow();
+  if (log)
+    ValuesToPixels<true>(xs, pxs, n, origin, m_posX, m_scaleX);
+  else
+    ValuesToPixels<false>(xs, pxs, n, origin, m_posX, m_scaleX);
 }
 
-void mpWindow::OnPaint(wxPaintEvent &WXUNUSED(event))
+void mpWindow::y2pArray(const double *ys, wxCoord *pys, size_t n, bool Y2, bool log, double origin) const
 {
-#ifdef _WIN32
-  wxPaintDC dc(this);
-#else
-  wxAutoBufferedPaintDC dc(this);
-#endif
-  int h, w;
-  dc.GetSize(&w, &h);   // This is the size of the visible area only!
-  SetScreen(w, h);
-  wxMemoryDC* m_buff_dc = NULL;
+  // pixel = (pos - y) * scale = (y - pos) * (-scale)
+  double pos = Y2 ? m_posY2 : m_posY;
+  double scale = Y2 ? -m_scaleY2 : -m_scaleY;
+  if (log)
+    ValuesToPixels<true>(ys, pys, n, origin, pos, scale);
+  else
+    ValuesToPixels<false>(ys, pys, n, origin, pos, scale);
+}
 
-#ifdef MATHPLOT_DO_LOGGING
+bool mpWindow::CheckAutoRange()
+{
+  if (!m_autoRange || m_lockaspect)
+    return false;
+
+  if (UpdateBBox() && AutoRange())
   {
-    int px = 0, py = 0;
-//    GetViewStart( &px, &py );
-    wxLogMessage(_T("[mpWindow::OnPaint] vis.area:%ix%i px=%i py=%i"), m_scrX, m_scrY, px, py);
+    UpdateAll();
+    return true;
   }
-#endif
+  return false;
+}
 
-  m_repainting = true;
+bool mpWindow::AutoRange()
+{
+  // Only a change of the data moves the view, not the zoom or the pan of the user
+  if (m_autoRangeBoundValid && (m_bound.Xmin == m_autoRangeBound.Xmin) && (m_bound.Xmax == m_autoRangeBound.Xmax)
+      && (m_bound.Ymin == m_autoRangeBound.Ymin) && (m_bound.Ymax == m_autoRangeBound.Ymax)
+      && (m_bound.Y2min == m_autoRangeBound.Y2min) && (m_bound.Y2max == m_autoRangeBound.Y2max))
+    return false;
+  m_autoRangeBound = m_bound;
+  m_autoRangeBoundValid = true;
 
-  // Selects direct or buffered draw:
-  wxDC* trgDc;
+  bool changedX = AutoRangeAxis(m_bound.Xmin, m_bound.Xmax, m_desired.Xmin, m_desired.Xmax);
+  bool changedY = AutoRangeAxis(m_bound.Ymin, m_bound.Ymax, m_desired.Ymin, m_desired.Ymax);
+  bool changedY2 = m_layersBoundValid[2] && AutoRangeAxis(m_bound.Y2min, m_bound.Y2max, m_desired.Y2min, m_desired.Y2max);
 
-  // J.L.Blanco @ Aug 2007: Added double buffer support
-  if (m_enableDoubleBuffer)
+  // Same adjustments as in Fit
+  if (changedX)
   {
-    // Recreate Bitmap if sizes have changed
-    if (m_last_lx != m_scrX || m_last_ly != m_scrY)
-    {
-      DeleteAndNull(m_buff_bmp);
-      m_buff_bmp = new wxBitmap(m_scrX, m_scrY, dc);
-      m_last_lx = m_scrX;
-      m_last_ly = m_scrY;
-    }
-    m_buff_dc = new wxMemoryDC(&dc);
-    m_buff_dc->SelectObject(*m_buff_bmp);
-    trgDc = m_buff_dc;
+    double Ax = m_desired.Xmax - m_desired.Xmin;
+    m_scaleX = ISNOTNULL(Ax) ? m_plotWidth / Ax : 1;
+    m_posX = (m_desired.Xmin + m_desired.Xmax) / 2 - (m_plotWidth / 2 + m_margin.left) / m_scaleX;
   }
-  else
+  if (changedY)
   {
-    trgDc = &dc;
+    double Ay = m_desired.Ymax - m_desired.Ymin;
+    m_scaleY = ISNOTNULL(Ay) ? m_plotHeight / Ay : 1;
+    m_posY = (m_desired.Ymin + m_desired.Ymax) / 2 + (m_plotHeight / 2 + m_margin.top) / m_scaleY;
+  }
+  if (changedY2)
+  {
+    double Ay2 = m_desired.Y2max - m_desired.Y2min;
+    m_scaleY2 = ISNOTNULL(Ay2) ? m_plotHeight / Ay2 : 1;
+    m_posY2 = (m_desired.Y2min + m_desired.Y2max) / 2 + (m_plotHeight / 2 + m_margin.top) / m_scaleY2;
   }
 
-  // Draw background
-  // Clean the screen
-  trgDc->Clear();
-  if (m_drawBox)
-    trgDc->SetPen(*wxBLACK);
-  else
-    trgDc->SetPen(*wxTRANSPARENT_PEN);
-  trgDc->SetBrush(*wxWHITE_BRUSH);
-  trgDc->DrawRectangle(0, 0, m_scrX, m_scrY);
+  return changedX || changedY || changedY2;
+}
 
-  // Draw background plot area
-  trgDc->SetBrush(m_bgColour);
-  trgDc->SetTextForeground(m_fgColour);
-  trgDc->DrawRectangle(m_margin.left - EXTRA_MARGIN, m_margin.top - EXTRA_MARGIN,
-      m_plotWidth + 2*EXTRA_MARGIN, m_plotHeight + 2*EXTRA_MARGIN);
+// Span given to a flat data range (a constant signal), as a fraction of its value, or 1 around 0
+#define mpAUTORANGE_FLAT_SPAN  0.1
 
-  // Draw all the layers in Z order
-  for (int i = mpZIndex_BACKGROUND; i < mpZIndex_END; i++)
+bool mpWindow::AutoRangeAxis(double dmin, double dmax, double &vmin, double &vmax)
+{
+  // A flat data range has no extent : the view would collapse to a single value
+  double middle = (dmin + dmax) / 2;
+  if ((dmax - dmin) <= 1e-12 * fabs(middle))
   {
-    for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
-    {
-      if ((*it)->GetZIndex() == i)
-        (*it)->Plot(*trgDc, *this);
-    }
+    double span = ISNOTNULL(middle) ? mpAUTORANGE_FLAT_SPAN * fabs(middle) : 1;
+    dmin = middle - span / 2;
+    dmax = middle + span / 2;
   }
 
-  // If doublebuffer, draw now to the window:
-  if (m_enableDoubleBuffer)
+  double oldMin = vmin, oldMax = vmax;
+  bool overMin = (dmin < vmin) || (vmax <= vmin);
+  bool overMax = (dmax > vmax) || (vmax <= vmin);
+
+  if (overMin || overMax)
   {
-    dc.Blit(0, 0, m_scrX, m_scrY, trgDc, 0, 0, wxCOPY);
-    m_buff_dc->SelectObject(wxNullBitmap);
-    delete m_buff_dc;
+    // Expand: the view grows geometrically on the side where the data overflows
+    double newMin = overMin ? dmin : vmin;
+    double newMax = overMax ? dmax : vmax;
+    double headroom = m_autoRangeHeadroom * (newMax - newMin);
+    vmin = overMin ? newMin - headroom : newMin;
+    vmax = overMax ? newMax + headroom : newMax;
   }
+  else
+    if ((dmax - dmin) < m_autoRangeHysteresis * (vmax - vmin))
+    {
+      // Contract: only when the data occupies a small part of the view
+      double headroom = m_autoRangeHeadroom * (dmax - dmin) / 2;
+      vmin = dmin - headroom;
+      vmax = dmax + headroom;
+    }
 
-  // We redraw the cross if necessary. We pass the mouse position if we do a pan operation.
-  if (m_magnetize)
-    m_magnet.UpdatePlot(dc, m_mouseRClick);
-
-  m_repainting = false;
+  // An unchanged range does not need a new view
+  return (vmin != oldMin) || (vmax != oldMax);
 }
 
-void mpWindow::SetMPScrollbars(bool status)
+bool mpWindow::UpdateBBox(bool fullRecompute)
 {
-  // Temporary behaviour: always disable scrollbars
-  m_enableScrollBars = status; //false;
-  if (status == false)
+  if (fullRecompute)
   {
-    SetScrollbar(wxHORIZONTAL, 0, 0, 0);
-    SetScrollbar(wxVERTICAL, 0, 0, 0);
+    // Query all the layers
+    for (mpLayerBBoxMap::iterator it = m_layersBBox.begin(); it != m_layersBBox.end(); it++)
+    {
+      it->second.changed = false;
+      QueryLayerBBox(it->first, it->second);
+    }
+    m_layersBBoxChanged.clear();
+    m_layersBoundDirty[0] = m_layersBoundDirty[1] = m_layersBoundDirty[2] = true;
   }
-  // else the scroll bars will be updated in UpdateAll();
-  UpdateAll();
-}
-
-void mpWindow::SetBound()
-{
-  bool HaveXAxis = (m_XAxis && (!m_XAxis->GetAuto()));
-  bool HaveYAxis = (m_YAxis && (!m_YAxis->GetAuto()));
-
-  if (HaveXAxis || HaveYAxis)
+  else
   {
-    mpFunctionType function;
-    for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+    // Query only the changed layers
+    for (std::vector<mpLayer*>::iterator it = m_layersBBoxChanged.begin(); it != m_layersBBoxChanged.end(); it++)
     {
-      if ((*it)->IsFunction(&function))
-      {
-        if ((function == mpfFX) && HaveXAxis)
-        {
-          m_bound.Ymin = ((mpFX*)(*it))->GetY(m_XAxis->GetMinScale());
-          m_bound.Ymax = ((mpFX*)(*it))->GetY(m_XAxis->GetMaxScale());
-        }
-        else
-          if ((function == mpfFY) && HaveYAxis)
-          {
-            m_bound.Xmin = ((mpFY*)(*it))->GetX(m_YAxis->GetMinScale());
-            m_bound.Xmax = ((mpFY*)(*it))->GetX(m_YAxis->GetMaxScale());
-          }
-      }
+      mpLayerBBox &bbox = m_layersBBox[*it];
+      mpLayerBBox oldBBox = bbox;
+      bbox.changed = false;
+      QueryLayerBBox(*it, bbox);
+      ApplyLayerBBox(oldBBox, bbox);
     }
+    m_layersBBoxChanged.clear();
   }
-}
-
-/**
- * Get the bounding of all visible series
- */
-bool mpWindow::UpdateBBox()
-{
-  bool first = true;
-  bool firstY = true;
-  bool firstY2 = true;
-
-  // To update bound of mpFX and mpFY functions
-//  SetBound();
 
-  // Search common bound for all functions
-  mpFloatRect f_bound;
-  mpFunctionType function;
-  for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+  // Recompute from the cache the ranges that can have shrunk
+  if (m_layersBoundDirty[0] || m_layersBoundDirty[1] || m_layersBoundDirty[2])
   {
-    mpLayer* f = *it;
-
-    if (f->HasBBox() && f->IsVisible())
+    bool dirty[3] = {m_layersBoundDirty[0], m_layersBoundDirty[1], m_layersBoundDirty[2]};
+    for (int i = 0; i < 3; i++)
     {
-      f->GetBBox(&f_bound);
-      if (first)
-      {
-        first = false;
-        m_bound.Xmin = f_bound.Xmin;
-        m_bound.Xmax = f_bound.Xmax;
-      }
-      else
-      {
-        if (f_bound.Xmin < m_bound.Xmin)
-          m_bound.Xmin = f_bound.Xmin;
-        if (f_bound.Xmax > m_bound.Xmax)
-          m_bound.Xmax = f_bound.Xmax;
-      }
-
-      if ((f->IsFunction(&function)) && (((mpFunction*)f)->GetY2Axis()))
-      {
-        if (firstY2)
-        {
-          m_bound.Y2min = f_bound.Ymin;
-          m_bound.Y2max = f_bound.Ymax;
-          firstY2 = false;
-        }
-        else
-        {
-          if (f_bound.Ymin < m_bound.Y2min)
-            m_bound.Y2min = f_bound.Ymin;
-          if (f_bound.Ymax > m_bound.Y2max)
-            m_bound.Y2max = f_bound.Ymax;
-        }
-      }
-      else
-      {
-        if (firstY)
-        {
-          m_bound.Ymin = f_bound.Ymin;
-          m_bound.Ymax = f_bound.Ymax;
-          firstY = false;
-        }
-        else
-        {
-          if (f_bound.Ymin < m_bound.Ymin)
-            m_bound.Ymin = f_bound.Ymin;
-          if (f_bound.Ymax > m_bound.Ymax)
-            m_bound.Ymax = f_bound.Ymax;
-        }
-      }
+      if (dirty[i])
+        m_layersBoundValid[i] = false;
+      m_layersBoundDirty[i] = false;
+    }
+    for (mpLayerBBoxMap::iterator it = m_layersBBox.begin(); it != m_layersBBox.end(); it++)
+    {
+      const mpLayerBBox &bbox = it->second;
+      if (!bbox.valid)
+        continue;
+      if (dirty[0])
+        UpdateBBoxRange(m_layersBound.Xmin, m_layersBound.Xmax, m_layersBoundValid[0], m_layersBoundDirty[0], false, 0, 0, true,
+            bbox.bound.Xmin, bbox.bound.Xmax);
+      if (dirty[1] && !bbox.isY2)
+        UpdateBBoxRange(m_layersBound.Ymin, m_layersBound.Ymax, m_layersBoundValid[1], m_layersBoundDirty[1], false, 0, 0, true,
+            bbox.bound.Ymin, bbox.bound.Ymax);
+      if (dirty[2] && bbox.isY2)
+        UpdateBBoxRange(m_layersBound.Y2min, m_layersBound.Y2max, m_layersBoundValid[2], m_layersBoundDirty[2], false, 0, 0, true,
+            bbox.bound.Ymin, bbox.bound.Ymax);
     }
   }
 
+  // Search common bound for all functions
+  if (m_layersBoundValid[0])
+  {
+    m_bound.Xmin = m_layersBound.Xmin;
+    m_bound.Xmax = m_layersBound.Xmax;
+  }
+  if (m_layersBoundValid[1])
+  {
+    m_bound.Ymin = m_layersBound.Ymin;
+    m_bound.Ymax = m_layersBound.Ymax;
+  }
+  if (m_layersBoundValid[2])
+  {
+    m_bound.Y2min = m_layersBound.Y2min;
+    m_bound.Y2max = m_layersBound.Y2max;
+  }
+
   // Take care of scale : restrict bound
   if (m_XAxis && (!m_XAxis->GetAuto()))
   {
@@ -3472,19 +5927,27 @@ bool mpWindow::UpdateBBox()
   (_T("[mpWindow::UpdateBBox] Bounding box: Xmin = %f, Xmax = %f, Ymin = %f, YMax = %f"), m_bound.Xmin, m_bound.Xmax, m_bound.Ymin,
       m_bound.Ymax);
 #endif // MATHPLOT_DO_LOGGING
-  return first == false;
+  return m_layersBoundValid[0];
 }
 
 void mpWindow::UpdateAll()
 {
-  if (m_magnetize)
+  // Wait for the end of the batch
+  if (m_updateDepth > 0)
   {
-    // To be sure to skip events that may occur before OnPaint
-    m_repainting = true;
-    m_magnet.SaveDrawState();
+    m_updatePendingAll = true;
+    return;
   }
 
-  if (UpdateBBox())
+  bool validBBox = UpdateBBox();
+
+  if (validBBox && m_autoRange && !m_lockaspect)
+    AutoRange();
+
+  if (m_autoScaleYVisible && !m_lockaspect)
+    AutoScaleYVisible();
+
+  if (validBBox)
   {
     if (m_enableScrollBars)
     {
@@ -3521,7 +5984,15 @@ void mpWindow::UpdateAll()
     }
   }
 
-  Refresh();
+  InvalidateFrame();
+}
+
+void mpWindow::InvalidateFrame()
+{
+  // Request a new frame. Only the last request before idle time will be rendered.
+  m_renderPending = true;
+  Refresh(false);
+  wxWakeUpIdle();
 }
 
 void mpWindow::DoScrollCalc(const int position, const int orientation)
@@ -3774,45 +6245,56 @@ mpLayer* mpWindow::GetClosestPlot(wxCoord ix, wxCoord iy, double *xnear, double
         case mpfFXYVector:
         {
           mpFXY* fxy = (mpFXY*)(*it);
-          double xx, yy;
+          double xs[mpXY_CHUNK], ys[mpXY_CHUNK];
+          size_t count;
           fxy->Rewind();
-          while (fxy->DoGetNextXY(&xx, &yy))
+          do
           {
-            if ((abs(this->x2p(xx) - ix) < NEAR_AREA) && (abs(this->y2p(yy, fxy->GetY2Axis()) - iy) < NEAR_AREA))
+            count = fxy->DoGetNextXYs(xs, ys, mpXY_CHUNK);
+            for (size_t i = 0; i < count; i++)
             {
-              *xnear = xx;
-              *ynear = yy;
-              *isY2Axis = fxy->GetY2Axis();
-              result = (*it);
-              break;
+              if ((abs(this->x2p(xs[i]) - ix) < NEAR_AREA) && (abs(this->y2p(ys[i], fxy->GetY2Axis()) - iy) < NEAR_AREA))
+              {
+                *xnear = xs[i];
+                *ynear = ys[i];
+                *isY2Axis = fxy->GetY2Axis();
+                result = (*it);
+                break;
+              }
             }
-          }
+          } while ((count == mpXY_CHUNK) && !result);
 
           break;
         }
         case mpfBar:
         {
           mpFXY* fxy = (mpFXY*)(*it);
-          double xx, yy;
+          double xs[mpXY_CHUNK], ys[mpXY_CHUNK];
+          size_t count;
           double zero = this->y2p(0.0, fxy->GetY2Axis());
           fxy->Rewind();
-          while (fxy->DoGetNextXY(&xx, &yy))
+          do
           {
-            // We are in the x bar range
-            if (abs(this->x2p(xx) - ix) < fxy->GetBarWidth())
+            count = fxy->DoGetNextXYs(xs, ys, mpXY_CHUNK);
+            for (size_t i = 0; i < count; i++)
             {
-              wxCoord yyp = this->y2p(yy, fxy->GetY2Axis());
-              // Check if we are over the bar
-              if (((yy < 0) && ((iy >= zero) && (iy < yyp + NEAR_AREA))) || ((yy > 0) && ((iy <= zero) && (iy > yyp - NEAR_AREA))))
+              // We are in the x bar range
+              if (abs(this->x2p(xs[i]) - ix) < fxy->GetBarWidth())
               {
-                *xnear = xx;
-                *ynear = yy;
-                *isY2Axis = fxy->GetY2Axis();
-                result = (*it);
-                break;
+                wxCoord yyp = this->y2p(ys[i], fxy->GetY2Axis());
+                // Check if we are over the bar
+                if (((ys[i] < 0) && ((iy >= zero) && (iy < yyp + NEAR_AREA)))
+                    || ((ys[i] > 0) && ((iy <= zero) && (iy > yyp - NEAR_AREA))))
+                {
+                  *xnear = xs[i];
+                  *ynear = ys[i];
+                  *isY2Axis = fxy->GetY2Axis();
+                  result = (*it);
+                  break;
+                }
               }
             }
-          }
+          } while ((count == mpXY_CHUNK) && !result);
 
           break;
         }
@@ -3828,21 +6310,94 @@ mpLayer* mpWindow::GetClosestPlot(wxCoord ix, wxCoord iy, double *xnear, double
 
 mpLayer* mpWindow::GetLayerByName(const wxString &name)
 {
-  for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
-    if ((*it)->GetName().IsSameAs(name))
-      return *it;
+  wxLayerNameMap::iterator it = m_layersByName.find(name);
+  if ((it != m_layersByName.end()) && !it->second.empty())
+    return it->second.front();
   return NULL;    // Not found
 }
 
 mpLayer* mpWindow::GetLayerByClassName(const wxString &name)
 {
-  for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
+  wxLayerNameMap::iterator it = m_layersByClass.find(name);
+  if ((it != m_layersByClass.end()) && !it->second.empty())
+    return it->second.front();
+  return NULL;    // Not found
+}
+
+/**
+ * Remove a layer from a list
+ * @return true if the layer was in the list
+ */
+static bool RemoveLayerFromList(wxLayerList &list, mpLayer *layer)
+{
+  for (wxLayerList::iterator it = list.begin(); it != list.end(); it++)
   {
-    wxString classname = (*it)->GetClassInfo()->GetClassName();
-    if (classname.IsSameAs(name))
-      return *it;
+    if (*it == layer)
+    {
+      list.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Remove a layer from the list of a key in a name index. The key is removed when its list is empty.
+ * @return true if the layer was in the index
+ */
+static bool RemoveLayerFromMap(wxLayerNameMap &map, const wxString &key, mpLayer *layer)
+{
+  wxLayerNameMap::iterator it = map.find(key);
+  if (it == map.end())
+    return false;
+  bool found = RemoveLayerFromList(it->second, layer);
+  if (it->second.empty())
+    map.erase(it);
+  return found;
+}
+
+void mpWindow::IndexLayer(mpLayer *layer)
+{
+  m_layersZ[layer->GetZIndex()].push_back(layer);
+  m_layersByName[layer->GetName()].push_back(layer);
+  m_layersByClass[layer->GetClassInfo()->GetClassName()].push_back(layer);
+}
+
+void mpWindow::UnindexLayer(mpLayer *layer)
+{
+  RemoveLayerFromList(m_layersZ[layer->GetZIndex()], layer);
+  RemoveLayerFromMap(m_layersByName, layer->GetName(), layer);
+  RemoveLayerFromMap(m_layersByClass, layer->GetClassInfo()->GetClassName(), layer);
+}
+
+/**
+ * Insert a layer in a list, keeping the insertion order of m_layers
+ */
+static void InsertLayerInOrder(wxLayerList &list, mpLayer *layer, const wxLayerList &order)
+{
+  wxLayerList::iterator pos = list.begin();
+  for (wxLayerList::const_iterator it = order.begin(); (it != order.end()) && (*it != layer); it++)
+  {
+    if ((pos != list.end()) && (*pos == *it))
+      pos++;
+  }
+  list.insert(pos, layer);
+}
+
+void mpWindow::UpdateLayerName(mpLayer *layer, const wxString &oldName)
+{
+  // The layer is perhaps no more attached to this window
+  if (RemoveLayerFromMap(m_layersByName, oldName, layer))
+    InsertLayerInOrder(m_layersByName[layer->GetName()], layer, m_layers);
+}
+
+void mpWindow::UpdateLayerZIndex(mpLayer *layer, mpLayerZOrder oldZIndex)
+{
+  if (RemoveLayerFromList(m_layersZ[oldZIndex], layer))
+  {
+    InsertLayerInOrder(m_layersZ[layer->GetZIndex()], layer, m_layers);
+    UpdateAll();
   }
-  return NULL;    // Not found
 }
 
 /**
@@ -4046,11 +6601,8 @@ wxBitmap* mpWindow::BitmapScreenshot(wxSize imageSize, bool fit)
   // Draw all the layers in Z order
   for (int i = mpZIndex_BACKGROUND; i < mpZIndex_END; i++)
   {
-    for (wxLayerList::iterator it = m_layers.begin(); it != m_layers.end(); it++)
-    {
-      if ((*it)->GetZIndex() == i)
-        (*it)->Plot(m_Screenshot_dc, *this);
-    }
+    for (wxLayerList::iterator it = m_layersZ[i].begin(); it != m_layersZ[i].end(); it++)
+      (*it)->Plot(m_Screenshot_dc, *this);
   }
   m_Screenshot_dc.SelectObject(wxNullBitmap);
 
@@ -4162,6 +6714,13 @@ void mpWindow::SetColourTheme(const wxColour &bgColour, const wxColour &drawColo
 
 void mpWindow::RefreshConfigWindow()
 {
+  // Wait for the end of the batch
+  if (m_updateDepth > 0)
+  {
+    m_updatePendingConfig = true;
+    return;
+  }
+
   if (m_configWindow)
     m_configWindow->Initialize();
 }
@@ -4432,6 +6991,7 @@ void mpMovableObject::ShapeUpdated()
         m_bbox_max_y = *itYo;
     }
   }
+  BBoxChanged();
 }
 
 void mpMovableObject::DoPlot(wxDC &dc, mpWindow &w)
@@ -4710,6 +7270,7 @@ void mpBitmapLayer::SetBitmap(const wxImage &inBmp, double x, double y, double l
     m_max_y = y + ly;
     m_validImg = true;
     m_bitmapChanged = true;
+    BBoxChanged();
   }
 }
 
@@ -4858,59 +7419,55 @@ void mpBitmapLayer::DoPlot(wxDC &dc, mpWindow &w)
 // mpMagnet
 //-----------------------------------------------------------------------------
 
-void mpMagnet::Plot(wxClientDC &dc, const wxPoint &mousePos)
+void mpMagnet::Plot(const wxPoint &mousePos)
 {
   if (m_domain.Contains(mousePos))
   {
-    if ((m_mousePosition.x != mousePos.x) || (m_mousePosition.y != mousePos.y))
+    // Not draw the cross when we just right click
+    if (m_rightClick)
     {
-      // Not draw the cross when we just right click
-      if (m_rightClick)
-      {
-        m_rightClick = false;
-      }
-      else
-      {
-        m_mousePosition = mousePos;
-        DrawCross(dc);
-        m_IsDrawn = true;
-      }
+      m_rightClick = false;
+      m_overlayShown = false;
+    }
+    else
+    {
+      m_mousePosition = mousePos;
+      m_overlayShown = true;
     }
   }
 }
 
-void mpMagnet::ClearPlot(wxClientDC &dc)
-{
-  if (m_IsDrawn)
-  {
-    DrawCross(dc);
-    m_IsDrawn = false;
-  }
-  // In any cases
-  m_IsWasDrawn = false;
-}
-
-void mpMagnet::UpdatePlot(wxClientDC &dc, const wxPoint &mousePos)
+void mpMagnet::GetOverlayRects(wxDC &WXUNUSED(dc), mpWindow &WXUNUSED(w), std::vector<wxRect> &rects)
 {
-  if (m_IsWasDrawn)
-  {
-    // Mouse position has changed when pan operation
-    if (m_rightClick)
-      m_mousePosition = mousePos;
-    DrawCross(dc);
-    m_IsDrawn = true;
-    m_IsWasDrawn = false;
-  }
+  // Just the two lines of the cross
+  rects.push_back(wxRect(m_mousePosition.x, m_plot_size.y, 1, m_plot_size.height - m_plot_size.y + 1));
+  rects.push_back(wxRect(m_plot_size.x, m_mousePosition.y, m_plot_size.width - m_plot_size.x + 1, 1));
 }
 
-void mpMagnet::DrawCross(wxClientDC &dc)
+void mpMagnet::DrawOverlay(wxDC &dc, mpWindow &WXUNUSED(w))
 {
-  // Note : wxINVERT not work on Linux GTK
+  // The area under the cross is restored from the frame, so we don't need wxINVERT (not work on Linux GTK)
   dc.SetPen(*wxBLACK_PEN);
-  dc.SetLogicalFunction(wxINVERT);
   dc.DrawLine(m_mousePosition.x, m_plot_size.y, m_mousePosition.x, m_plot_size.height);
   dc.DrawLine(m_plot_size.x, m_mousePosition.y, m_plot_size.width, m_mousePosition.y);
-  dc.SetLogicalFunction(wxCOPY);
+}
+
+//-----------------------------------------------------------------------------
+// mpZoomBox
+//-----------------------------------------------------------------------------
+
+void mpZoomBox::GetOverlayRects(wxDC &WXUNUSED(dc), mpWindow &WXUNUSED(w), std::vector<wxRect> &rects)
+{
+  rects.push_back(m_box);
+}
+
+void mpZoomBox::DrawOverlay(wxDC &dc, mpWindow &WXUNUSED(w))
+{
+  // Draw the rectangle that focus the selected region
+  wxPen pen(*wxBLACK, 1, wxPENSTYLE_DOT);  // wxDOT
+  dc.SetPen(pen);
+  dc.SetBrush(*wxTRANSPARENT_BRUSH);
+  dc.DrawRectangle(m_box);
 }
 
 //-----------------------------------------------------------------------------
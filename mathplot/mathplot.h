@@ -82,9 +82,15 @@
 #include <wx/print.h>
 #include <wx/image.h>
 #include <wx/intl.h>
+#include <wx/hashmap.h>
 
 #include <cmath>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #include "MathPlotConfig.h"
 
@@ -339,6 +345,201 @@ typedef enum __mp_Layer_ZOrder
   mpZIndex_END           //!< Just the end of ZOrder
 } mpLayerZOrder;
 
+/**
+ * Scratch surface to save and restore a small area of a device context.
+ * Used for the transient drawings (info coordinates, zoom box) : the area under the drawing is
+ * saved before drawing and restored to erase it. The bitmap and the memory dc are kept between
+ * calls and the bitmap only grows, so no allocation is done while moving the mouse.
+ */
+class mpBackingStore
+{
+  public:
+    mpBackingStore()
+    {
+      m_saved = false;
+    }
+    ~mpBackingStore()
+    {
+      Release();
+    }
+
+    /** Save the area rect of the dc */
+    void Save(wxDC &dc, const wxRect &rect);
+
+    /** Restore the saved area in the dc, then forget it */
+    void Restore(wxDC &dc);
+
+    /** Forget the saved area, for example when all the plot is repainted */
+    void Invalidate()
+    {
+      m_saved = false;
+    }
+
+    /** Release the scratch bitmap */
+    void Release();
+
+    /** Is an area saved ? */
+    bool IsSaved() const
+    {
+      return m_saved;
+    }
+
+    /** The saved area */
+    const wxRect& GetRect() const
+    {
+      return m_rect;
+    }
+
+    /** The memory dc of the scratch bitmap, to draw above the saved area before restoring it */
+    wxDC& GetDC()
+    {
+      return m_dc;
+    }
+
+  private:
+    wxBitmap m_bmp;      //!< The scratch bitmap, never shrinks
+    wxMemoryDC m_dc;     //!< Memory dc with m_bmp selected
+    wxRect m_rect;       //!< The saved area in the dc coordinates
+    bool m_saved;        //!< Is m_rect saved in m_bmp ?
+};
+
+/**
+ * Range minimum and maximum query over an indexed list of values (segment tree).
+ * The min and max of any range of consecutive values are given in O(log n).
+ * Values can be appended in amortized O(log n), this is used for streaming series.
+ */
+class mpRangeMinMax
+{
+  public:
+    mpRangeMinMax()
+    {
+      m_size = 0;
+      m_capacity = 0;
+    }
+
+    /** Build the tree with the values */
+    void Build(const std::vector<double> &values);
+
+    /** Append a value at the end */
+    void Append(double value);
+
+    /** Remove all the values */
+    void Clear();
+
+    /** Get the min and max of the values in the index range [first, last[
+     @return false if the range is empty */
+    bool Query(size_t first, size_t last, double *min, double *max) const;
+
+    /** The number of values */
+    size_t GetSize() const
+    {
+      return m_size;
+    }
+
+  private:
+    size_t m_size;              //!< Number of values
+    size_t m_capacity;          //!< Number of leaves, a power of 2
+    std::vector<double> m_min;  //!< Min of each node, the leaves are at [m_capacity, 2*m_capacity[
+    std::vector<double> m_max;  //!< Max of each node
+
+    /** Build the tree with the values and a given number of leaves */
+    void Rebuild(const std::vector<double> &values, size_t capacity);
+};
+
+/**
+ * Pool of worker threads, used to evaluate the functions in parallel.
+ * A range of indexes is split in chunks, executed by the workers and the calling thread.
+ * The pool shared by all the layers is given by mpThreadPool::Get.
+ */
+class WXDLLIMPEXP_MATHPLOT mpThreadPool
+{
+  public:
+    /** @param threads Number of worker threads. The calling thread also executes a chunk. */
+    mpThreadPool(unsigned int threads);
+    ~mpThreadPool();
+
+    /** The pool shared by the layers, with one thread per core. Created on the first call. */
+    static mpThreadPool& Get();
+
+    /** Stop the threads of the shared pool and delete it.
+     Called when the wx library is cleaned up, so the threads are not joined by a static destructor
+     (which may deadlock when the library is unloaded from a DLL). */
+    static void Shutdown();
+
+    /** Execute task(first, last) on chunks covering [0, n[ and wait for the end of all the chunks.
+     If a chunk throws an exception, the other chunks are still waited for, then the first exception is rethrown.
+     Several threads may call Run at the same time.
+     @param n Number of indexes
+     @param minChunk Minimum number of indexes of a chunk
+     @param task The task, must be thread safe */
+    void Run(size_t n, size_t minChunk, const std::function<void(size_t, size_t)> &task);
+
+    /** The number of worker threads */
+    unsigned int GetThreadCount() const
+    {
+      return (unsigned int)m_threads.size();
+    }
+
+  private:
+    std::vector<std::thread> m_threads;         //!< The worker threads
+    std::deque<std::function<void()> > m_tasks; //!< The chunks waiting for a worker
+    std::mutex m_mutex;                         //!< Protects m_tasks, m_stop and the state of the calls of Run
+    std::condition_variable m_wake;             //!< Signals a new chunk or the stop to the workers
+    std::condition_variable m_done;             //!< Signals the end of a chunk to Run
+    bool m_stop;                                //!< Stop the workers
+
+    /** The loop of a worker thread */
+    void Worker();
+};
+
+/**
+ * Overlay, abstract base class for the transient drawings done above the plot
+ * (mouse cross, zoom box, info coordinates, ...).
+ * The overlays are not drawn in the rendered frame. When mpWindow::RefreshOverlays is called,
+ * the areas covered by the overlays are restored from the frame and the overlays are drawn again,
+ * so an overlay can be moved without repainting the plot.
+ * New overlays are added with mpWindow::AddOverlay.
+ */
+class WXDLLIMPEXP_MATHPLOT mpOverlay
+{
+  public:
+    mpOverlay()
+    {
+      m_overlayShown = true;
+    }
+    virtual ~mpOverlay()
+    {
+      ;
+    }
+
+    /** Append the areas covered by the overlay, in window coordinates.
+     Nothing is appended if there is nothing to draw.
+     @param dc the device context, can be used to compute text extent
+     @param w the window
+     @param rects the list of areas */
+    virtual void GetOverlayRects(wxDC &dc, mpWindow &w, std::vector<wxRect> &rects) = 0;
+
+    /** Draw the overlay.
+     @param dc the device context where to draw
+     @param w the window */
+    virtual void DrawOverlay(wxDC &dc, mpWindow &w) = 0;
+
+    /** Show or hide the overlay. mpWindow::RefreshOverlays must be called to update the window. */
+    void ShowOverlay(bool show)
+    {
+      m_overlayShown = show;
+    }
+
+    /** Is the overlay shown ? */
+    bool IsOverlayShown() const
+    {
+      return m_overlayShown;
+    }
+
+  protected:
+    bool m_overlayShown;  //!< The overlay is shown
+};
+
 /** Plot layer, abstract base class.
  Any number of mpLayer implementations can be attached to mpWindow.
  Examples for mpLayer implementations are function graphs, or scale rulers.
@@ -367,6 +568,12 @@ class WXDLLIMPEXP_MATHPLOT mpLayer: public wxObject
       m_win = &w;
     }
 
+    /** Detach the layer from its window, when it is removed but not deleted */
+    void ResetWindow()
+    {
+      m_win = NULL;
+    }
+
     /** Check whether this layer has a bounding box.
      The default implementation returns \a TRUE. Override and return
      FALSE if your mpLayer implementation should be ignored by the calculation
@@ -505,10 +712,7 @@ class WXDLLIMPEXP_MATHPLOT mpLayer: public wxObject
     /** Set layer name
      @param name Name, will be copied to internal class member
      */
-    void SetName(const wxString &name)
-    {
-      m_name = name;
-    }
+    void SetName(const wxString &name);
 
     /** Get layer name.
      @return Name
@@ -637,8 +841,14 @@ class WXDLLIMPEXP_MATHPLOT mpLayer: public wxObject
     virtual void SetVisible(bool show)
     {
       m_visible = show;
+      BBoxChanged();
     }
 
+    /** Notify the window that the bounding box of the layer has changed (new data, visibility, ...).
+     The window updates its global bounding box with only the changed layers.
+     */
+    void BBoxChanged();
+
     /** Checks whether the layer is tractable or not.
      @return \a true if visible */
     inline bool IsTractable()
@@ -688,6 +898,10 @@ class WXDLLIMPEXP_MATHPLOT mpLayer: public wxObject
       return m_ZIndex;
     }
 
+    /** Set the ZIndex of the plot, to change the drawing order.
+     @param ZIndex the new index in Z-Order*/
+    void SetZIndex(mpLayerZOrder ZIndex);
+
   protected:
     mpWindow* m_win;            //!< The wxWindow handle
     mpLayerType m_type;         //!< Define layer type, which is assigned by constructor
@@ -825,7 +1039,7 @@ class WXDLLIMPEXP_MATHPLOT mpInfoLayer: public mpLayer
  @brief Implements an overlay box which shows the mouse coordinates in plot units.
  When an mpInfoCoords layer is activated, when mouse is moved over the mpWindow,
  its coordinates (in mpWindow units, not pixels) are continuously reported inside the layer box. */
-class WXDLLIMPEXP_MATHPLOT mpInfoCoords: public mpInfoLayer
+class WXDLLIMPEXP_MATHPLOT mpInfoCoords: public mpInfoLayer, public mpOverlay
 {
   public:
     /** Default constructor */
@@ -840,9 +1054,6 @@ class WXDLLIMPEXP_MATHPLOT mpInfoCoords: public mpInfoLayer
      @param location to place in the margin or free */
     mpInfoCoords(wxRect rect, const wxBrush &brush = *wxTRANSPARENT_BRUSH, mpLocation location = mpMarginNone);
 
-    /** Default destructor */
-    ~mpInfoCoords();
-
     virtual void SetVisible(bool show);
 
     /** Updates the content of the info box. It is used to update coordinates.
@@ -856,8 +1067,18 @@ class WXDLLIMPEXP_MATHPLOT mpInfoCoords: public mpInfoLayer
      @sa mpLayer::Plot */
     virtual void DoPlot(wxDC &dc, mpWindow &w);
 
+    /** Hide the info box until the next mouse move.
+     mpWindow::RefreshOverlays must be called to update the window. */
     void ErasePlot(wxDC &dc, mpWindow &w);
 
+    /** The area of the info box, when used as an overlay of the window.
+     @sa mpOverlay::GetOverlayRects */
+    virtual void GetOverlayRects(wxDC &dc, mpWindow &w, std::vector<wxRect> &rects);
+
+    /** Draw the info box, when used as an overlay of the window.
+     @sa mpOverlay::DrawOverlay */
+    virtual void DrawOverlay(wxDC &dc, mpWindow &w);
+
     /** Set X axis label view mode.
      @param mode mpX_NORMAL for normal labels, mpX_TIME for time axis in hours, minutes, seconds. */
     void SetLabelMode(unsigned int mode, unsigned int time_conv = mpX_RAWTIME)
@@ -902,11 +1123,15 @@ class WXDLLIMPEXP_MATHPLOT mpInfoCoords: public mpInfoLayer
     unsigned int m_timeConv;
     wxCoord m_mouseX;
     wxCoord m_mouseY;
-    wxBitmap* m_coord_bmp;
-    wxRect m_oldDim;
     bool m_series_coord;
     wxPen m_penSeries;
 
+    /** Compute the size and position of the info box */
+    void LayoutBox(wxDC &dc, mpWindow &w);
+
+    /** Draw the info box at its position */
+    void DrawBox(wxDC &dc);
+
   DECLARE_DYNAMIC_CLASS(mpInfoCoords)
 };
 
@@ -1034,6 +1259,68 @@ class WXDLLIMPEXP_MATHPLOT mpFunction: public mpLayer
       return m_step;
     }
 
+    /** Enable/disable the adaptive sampling of the continuous plot (mpFX and mpFY only).
+     In place of one evaluation every step pixels, the function is evaluated on a coarse grid and the
+     intervals are subdivided where the curve deviates from a straight line by more than half a pixel,
+     or where the slope changes sign or size sharply, down to intervals of one pixel.
+     Flat regions need fewer evaluations, the curved regions keep the precision of the pixel.
+     The adaptive sampling is not used when a symbol is set, since the symbols are drawn at each step.
+     @param adaptive Enable the adaptive sampling
+     @param budget Maximum number of evaluations per frame, at least 2 (the ends of the plot) */
+    void SetAdaptiveSampling(bool adaptive, unsigned int budget = 4096)
+    {
+      m_adaptive = adaptive;
+      m_adaptiveBudget = (budget < 2) ? 2 : budget;
+    }
+
+    /** Get the adaptive sampling status.
+     @return true if the adaptive sampling is enabled */
+    bool GetAdaptiveSampling() const
+    {
+      return m_adaptive;
+    }
+
+    /** Enable/disable the cache of the function values (mpFX and mpFY only).
+     The function is evaluated on a grid of the argument axis derived from the view scale, and the values
+     of the last frame are kept. A repaint without a change of the view evaluates nothing, and a pan
+     evaluates only the new pixels. The adaptive sampling does not use the cache.
+     Call InvalidateCache when the function itself changes.
+     @param cached Enable the cache */
+    void SetCached(bool cached)
+    {
+      m_cached = cached;
+      InvalidateCache();
+    }
+
+    /** Get the cache status.
+     @return true if the function values are cached */
+    bool GetCached() const
+    {
+      return m_cached;
+    }
+
+    /** Discard the cached function values. To be called when the function has changed. */
+    void InvalidateCache()
+    {
+      m_cacheValid = false;
+    }
+
+    /** Enable/disable the parallel evaluation of the function (mpFX and mpFY only).
+     The samples of a frame are split on the threads of mpThreadPool::Get, the plot is still
+     drawn by the GUI thread. GetY/GetX (or GetYs/GetXs) must be thread safe.
+     @param parallel Enable the parallel evaluation */
+    void SetParallel(bool parallel)
+    {
+      m_parallel = parallel;
+    }
+
+    /** Get the parallel evaluation status.
+     @return true if the function is evaluated in parallel */
+    bool GetParallel() const
+    {
+      return m_parallel;
+    }
+
     /** Set symbol.
      @param symbol (choose between mps...) */
     void SetSymbol(mpSymbol symbol)
@@ -1074,6 +1361,7 @@ class WXDLLIMPEXP_MATHPLOT mpFunction: public mpLayer
     void SetY2Axis(bool _useY2)
     {
       m_UseY2Axis = _useY2;
+      BBoxChanged();
     }
 
     /** Get use of second Y axis
@@ -1084,6 +1372,17 @@ class WXDLLIMPEXP_MATHPLOT mpFunction: public mpLayer
       return m_UseY2Axis;
     }
 
+    /** Get the Y extent of the function for the X values in [xmin, xmax].
+     Used by mpWindow to scale the Y axis on the visible X range.
+     The default implementation returns false : not supported.
+     @param xmin, xmax the X range
+     @param ymin, ymax return the Y extent
+     @return true if the extent is available */
+    virtual bool GetYRange(double WXUNUSED(xmin), double WXUNUSED(xmax), double *WXUNUSED(ymin), double *WXUNUSED(ymax))
+    {
+      return false;
+    }
+
   protected:
     bool m_continuous;          //!< Specify if the layer will be plotted as a continuous line or a set of points. Default false
     mpSymbol m_symbol;          //!< A symbol for the plot in place of point. Default mpNone
@@ -1096,6 +1395,64 @@ class WXDLLIMPEXP_MATHPLOT mpFunction: public mpLayer
      */
     bool m_UseY2Axis;
 
+    std::vector<double> m_samplesArg;   //!< Arguments of the function for the samples of the frame
+    std::vector<double> m_samplesValue; //!< Function values for the samples of the frame
+    std::vector<wxCoord> m_samplesPx;   //!< Function values in pixels for the samples of the frame
+
+    bool m_adaptive;                    //!< Adaptive sampling of the continuous plot. Default false
+    unsigned int m_adaptiveBudget;      //!< Maximum number of evaluations per frame of the adaptive sampling
+    std::vector<double> m_adaptivePos;  //!< Positions in pixels of the adaptive samples
+    std::vector<double> m_adaptiveValue; //!< Function values in pixels of the adaptive samples
+
+    bool m_cached;                      //!< Cache the function values. Default false
+    bool m_cacheValid;                  //!< Is the cache valid
+    double m_cacheScale;                //!< Scale of the argument axis of the cached values
+    wxInt64 m_cacheFirst;               //!< Grid index of the first cached value
+    wxInt64 m_cacheStride;              //!< Grid index increment between two cached values
+    std::vector<double> m_cacheValues;  //!< Cached function values
+    std::vector<size_t> m_cacheMissing; //!< Samples of the frame not found in the cache
+    std::vector<double> m_cacheMissingArg; //!< Arguments of the missing samples
+    std::vector<double> m_cacheMissingValue; //!< Function values of the missing samples
+
+    bool m_parallel;                    //!< Evaluate the function in parallel. Default false
+
+    /** Evaluate the function for an array of arguments with DoGetValues, in parallel if enabled */
+    void DoEvaluate(const double *args, double *values, size_t n);
+
+    /** Evaluate the function for an array of arguments (GetYs or GetXs). Used by the cache. */
+    virtual void DoGetValues(const double *WXUNUSED(args), double *WXUNUSED(values), size_t WXUNUSED(n))
+    {
+      ;
+    }
+
+    /** Fill m_samplesArg and m_samplesValue with the n samples from the pixel start by m_step, through the cache.
+     The arguments are snapped on the grid of the argument axis: argument = index / scale.
+     @param origin Argument at the pixel 0
+     @param scale Scale of the argument axis (pixels per unit)
+     @param reversed true if the argument decreases when the pixel increases (Y axis)
+     @param start First pixel
+     @param n Number of samples */
+    void DoGetCachedValues(double origin, double scale, bool reversed, wxCoord start, size_t n);
+
+    /** Evaluate the function for fractional pixel positions, used by the adaptive sampling.
+     @param w The window
+     @param pos Positions in pixels along the argument axis
+     @param values Function values in pixels
+     @param n Number of positions */
+    virtual void DoGetSamples(mpWindow &WXUNUSED(w), const double *WXUNUSED(pos), double *WXUNUSED(values), size_t WXUNUSED(n))
+    {
+      ;
+    }
+
+    /** Adaptive sampling of the function between the pixels start and end (excluded).
+     The samples are stored in m_adaptivePos and m_adaptiveValue, sorted by position.
+     @return the number of samples */
+    size_t DoAdaptiveSampling(mpWindow &w, wxCoord start, wxCoord end);
+
+    /** Draw the adaptive samples as a continuous line.
+     @param horizontal true if the positions are along the X axis (mpFX) */
+    void DrawAdaptiveSamples(wxDC &dc, size_t n, bool horizontal);
+
   DECLARE_DYNAMIC_CLASS(mpFunction)
 };
 
@@ -1178,6 +1535,15 @@ class WXDLLIMPEXP_MATHPLOT mpFX: public mpFunction
      */
     virtual double GetY(double x) = 0;
 
+    /** Get function values for an array of arguments.
+     The plot handler calls it once per frame with all the sample abscissae, so an expensive function
+     can be evaluated in a single call. The default implementation calls GetY for each argument.
+     @param xs Arguments
+     @param ys Function values
+     @param n Number of arguments
+     */
+    virtual void GetYs(const double *xs, double *ys, size_t n);
+
     /**
      * Get function value with log test
      */
@@ -1199,10 +1565,105 @@ class WXDLLIMPEXP_MATHPLOT mpFX: public mpFunction
     }
 
   protected:
+    /** Evaluate the function for the pixels from startPx to endPx (excluded) by m_step.
+     The values in pixels are stored in m_samplesPx.
+     @return the number of samples */
+    size_t DoGetYs(mpWindow &w, wxCoord startPx, wxCoord endPx);
+
+    virtual void DoGetSamples(mpWindow &w, const double *pos, double *values, size_t n);
+
+    virtual void DoGetValues(const double *args, double *values, size_t n)
+    {
+      GetYs(args, values, n);
+    }
 
   DECLARE_DYNAMIC_CLASS(mpFX)
 };
 
+/** Operation codes of the bytecode of mpFXExpression */
+typedef enum __mp_Expression_Op
+{
+  mpEXPR_CONST,   //!< Push a constant
+  mpEXPR_X,       //!< Push the argument
+  mpEXPR_ADD,
+  mpEXPR_SUB,
+  mpEXPR_MUL,
+  mpEXPR_DIV,
+  mpEXPR_POW,
+  mpEXPR_NEG,
+  mpEXPR_SIN,
+  mpEXPR_COS,
+  mpEXPR_TAN,
+  mpEXPR_ASIN,
+  mpEXPR_ACOS,
+  mpEXPR_ATAN,
+  mpEXPR_SINH,
+  mpEXPR_COSH,
+  mpEXPR_TANH,
+  mpEXPR_EXP,
+  mpEXPR_LOG,
+  mpEXPR_LOG10,
+  mpEXPR_SQRT,
+  mpEXPR_ABS
+} mpExpressionOp;
+
+/** An instruction of the bytecode of mpFXExpression */
+typedef struct
+{
+    mpExpressionOp op;  //!< The operation
+    double value;       //!< The constant for mpEXPR_CONST
+} mpExpressionInstr;
+
+/** Function F:X->Y given by a formula, typed at run time.
+ The formula is parsed once into a bytecode for a stack machine. Each instruction is applied
+ to a whole block of arguments, so the evaluation of a frame is a set of tight loops.
+ The syntax is the usual one: numbers, the argument x, the constants pi and e, the operators + - * / ^
+ (power, right associative), the parentheses and the functions sin cos tan asin acos atan sinh cosh tanh
+ exp log (natural) log10 sqrt abs. Example: "2*sin(x)^2 - exp(-x/10)".
+ The evaluation is thread safe, so the layer can be evaluated in parallel (see mpFunction::SetParallel).
+ */
+class WXDLLIMPEXP_MATHPLOT mpFXExpression: public mpFX
+{
+  public:
+    /** @param expression The formula
+     @param name  Label
+     @param flags Label alignment, pass one of #mpALIGN_RIGHT, #mpALIGN_CENTER, #mpALIGN_LEFT.
+     */
+    mpFXExpression(const wxString &expression = wxEmptyString, const wxString &name = wxEmptyString, int flags = mpALIGN_RIGHT,
+        bool useY2Axis = false);
+
+    /** Set and compile the formula. The layer is not plotted if the formula is not valid.
+     @param expression The formula
+     @return false if the formula is not valid, the error is logged */
+    bool SetExpression(const wxString &expression);
+
+    /** Get the formula */
+    const wxString& GetExpression() const
+    {
+      return m_expression;
+    }
+
+    /** Is the formula valid ? */
+    bool IsValid() const
+    {
+      return !m_code.empty();
+    }
+
+    virtual double GetY(double x);
+
+    virtual void GetYs(const double *xs, double *ys, size_t n);
+
+    /** Plot only a valid formula */
+    virtual void DoPlot(wxDC &dc, mpWindow &w);
+
+  protected:
+    wxString m_expression;                   //!< The formula
+    std::vector<mpExpressionInstr> m_code;   //!< The bytecode, empty if the formula is not valid
+    size_t m_stackSize;                      //!< Maximum depth of the stack used by the bytecode
+
+  DECLARE_DYNAMIC_CLASS(mpFXExpression)
+};
+
 /** Abstract base class providing plot and labeling functionality for functions F:Y->X.
  Override mpFY::GetX to implement a function.
  Override mpFY::GetMinX and mpFY::GetMaxX to provide min and max X range
@@ -1224,6 +1685,15 @@ class WXDLLIMPEXP_MATHPLOT mpFY: public mpFunction
      */
     virtual double GetX(double y) = 0;
 
+    /** Get function values for an array of arguments.
+     The plot handler calls it once per frame with all the sample ordinates, so an expensive function
+     can be evaluated in a single call. The default implementation calls GetX for each argument.
+     @param ys Arguments
+     @param xs Function values
+     @param n Number of arguments
+     */
+    virtual void GetXs(const double *ys, double *xs, size_t n);
+
     /**
      * Get function value with log test
      */
@@ -1245,10 +1715,38 @@ class WXDLLIMPEXP_MATHPLOT mpFY: public mpFunction
     }
 
   protected:
+    /** Evaluate the function for the pixels from startPy to endPy (excluded) by m_step.
+     The values in pixels are stored in m_samplesPx.
+     @return the number of samples */
+    size_t DoGetXs(mpWindow &w, wxCoord startPy, wxCoord endPy);
+
+    virtual void DoGetSamples(mpWindow &w, const double *pos, double *values, size_t n);
+
+    virtual void DoGetValues(const double *args, double *values, size_t n)
+    {
+      GetXs(args, values, n);
+    }
 
   DECLARE_DYNAMIC_CLASS(mpFY)
 };
 
+/** Kind of the inner plot loop of mpFXY, resolved at compile time */
+typedef enum __mp_Plot_Loop
+{
+  mpLOOP_LINES,       //!< Continuous line
+  mpLOOP_WIDE_POINTS, //!< Points drawn as lines of length 0 (pen width > 1)
+  mpLOOP_POINTS,      //!< Points
+  mpLOOP_BARS         //!< Bars
+} mpPlotLoop;
+
+/** Decimation of the points of a mpFXY layer. The reduction factor is the step (see mpFunction::SetStep) */
+typedef enum __mp_Decimation_Type
+{
+  mpDECIMATION_NONE,   //!< Keep one point every step, the points between are dropped. Default
+  mpDECIMATION_MINMAX, //!< Keep the min and the max of each bucket of 2*step points, the envelope is kept
+  mpDECIMATION_LTTB    //!< Largest-Triangle-Three-Buckets: keep the point of each bucket giving the largest triangle
+} mpDecimation;
+
 /** Abstract base class providing plot and labeling functionality for a locus plot F:N->X,Y.
  Locus argument N is assumed to be in range 0 .. MAX_N, and implicitly derived by enumerating
  all locus values.
@@ -1289,7 +1787,42 @@ class WXDLLIMPEXP_MATHPLOT mpFXY: public mpFunction
     /**
      * Get function value with log test
      */
-    bool DoGetNextXY(double *x, double *y);
+    virtual bool DoGetNextXY(double *x, double *y);
+
+    /** Get the next values of the locus by chunk, in the buffers of the caller.
+     The default implementation calls GetNextXY for each point, override it to copy the data in bulk.
+     @param xs Buffer for the X values
+     @param ys Buffer for the Y values
+     @param n Size of the buffers
+     @return the number of points copied, less than n at the end of the locus
+     */
+    virtual size_t GetNextXYs(double *xs, double *ys, size_t n);
+
+    /**
+     * Get the next values by chunk with log test
+     */
+    virtual size_t DoGetNextXYs(double *xs, double *ys, size_t n);
+
+    /** Get the points as contiguous arrays, with log test as DoGetNextXY. The plot uses them in place of
+     the enumeration with DoGetNextXY. The default implementation returns false : not supported.
+     @param xs Returns the X values
+     @param ys Returns the Y values
+     @param count Returns the number of points
+     @param originX Returns the origin added to the X values
+     @param originY Returns the origin added to the Y values
+     @return true if the arrays are available */
+    virtual bool GetXYArrays(const double **WXUNUSED(xs), const double **WXUNUSED(ys), size_t *WXUNUSED(count),
+        double *WXUNUSED(originX), double *WXUNUSED(originY))
+    {
+      return false;
+    }
+
+    /** Are the X values given by GetXYArrays sorted in ascending order ? The plot then only transforms and draws
+     the points of the visible X range. The default implementation returns false. */
+    virtual bool IsXSorted()
+    {
+      return false;
+    }
 
     /** Layer plot handler.
      This implementation will plot the locus in the visible area and
@@ -1319,6 +1852,16 @@ class WXDLLIMPEXP_MATHPLOT mpFXY: public mpFunction
       return m_BarWidth;
     }
 
+    /** Set the decimation of the points, used when the step is greater than 1.
+     @param decimation One of mpDECIMATION_NONE, mpDECIMATION_MINMAX, mpDECIMATION_LTTB */
+    void SetDecimation(mpDecimation decimation);
+
+    /** Get the decimation of the points */
+    mpDecimation GetDecimation() const
+    {
+      return m_decimation;
+    }
+
   protected:
 
     // Data to calculate label positioning
@@ -1342,6 +1885,25 @@ class WXDLLIMPEXP_MATHPLOT mpFXY: public mpFunction
      */
     void UpdateViewBoundary(wxCoord xnew, wxCoord ynew);
 
+    // Copy of the points for the layers without GetXYArrays
+    std::vector<double> m_plotXs, m_plotYs;
+
+    // Decimation of the points
+    mpDecimation m_decimation;
+    std::vector<double> m_decimXs, m_decimYs;
+
+    /** Decimate the points by the step in m_decimXs and m_decimYs, according to m_decimation
+     @return the number of points kept */
+    size_t DoDecimate(const double *xs, const double *ys, size_t count);
+
+    /** The inner plot loop, instantiated for each kind of loop and with or without symbol,
+     so there is no test by point.
+     @param stride Index increment between two plotted points
+     @param originX, originY Origin of the values */
+    template <mpPlotLoop loop, bool symbol>
+    void DoPlotPoints(wxDC &dc, mpWindow &w, const double *xs, const double *ys, size_t count, size_t stride,
+        double originX, double originY);
+
   DECLARE_DYNAMIC_CLASS(mpFXY)
 };
 
@@ -1400,6 +1962,8 @@ class WXDLLIMPEXP_MATHPLOT mpFXYVector: public mpFXY
      * @param y
      * @param updatePlot. boolean, set true to update plot. This speed the rendering because just new point is drawing.
      * @return true if limits are changed (and may some refresh)
+     * When the automatic range of the window is enabled (see mpWindow::SetAutoRange), the window adjusts
+     * the view itself and true is returned only when the view has been changed.
      */
     bool AddData(const double x, const double y, bool updatePlot);
 
@@ -1434,11 +1998,47 @@ class WXDLLIMPEXP_MATHPLOT mpFXYVector: public mpFXY
       return true;
     }
 
+    /** Get the Y extent of the points in the X range, in O(log n) if the X values are sorted.
+     The points just outside the range are included, since the lines to them are visible.
+     If the X values are not sorted, the extent of the whole series is returned.
+     @sa mpFunction::GetYRange */
+    virtual bool GetYRange(double xmin, double xmax, double *ymin, double *ymax);
+
+    /** Set the origin of the data. The values given to SetData and AddData are relative to this origin,
+     so large coordinates (timestamps, geographic coordinates) keep their precision when stored as small
+     offsets. The plot transforms the offsets relative to the view, without rebuilding the absolute values.
+     Note that only the stored values keep their precision: the view of the mpWindow (position, bounds,
+     scales and axis ticks) is still in absolute coordinates, so its resolution is about 2^-52 of the
+     magnitude of the coordinates (a step of 256 around 1.7e18). Zooming below this resolution is not possible,
+     whatever the origin of the data.
+     Default origin is (0, 0). This method DOES NOT refresh the mpWindow; do it manually.
+     @param originX Origin of the X values
+     @param originY Origin of the Y values */
+    void SetDataOrigin(double originX, double originY);
+
+    /** Get the X origin of the data
+     @sa SetDataOrigin */
+    double GetDataOriginX() const
+    {
+      return m_originX;
+    }
+
+    /** Get the Y origin of the data
+     @sa SetDataOrigin */
+    double GetDataOriginY() const
+    {
+      return m_originY;
+    }
+
   protected:
-    /** The internal copy of the set of data to draw.
+    /** The internal copy of the set of data to draw, relative to the origin.
      */
     std::vector<double> m_xs, m_ys;
 
+    /** The origin of the data, see SetDataOrigin
+     */
+    double m_originX, m_originY;
+
     /** Memory reserved for m_xs and m_ys. Default 1000
      */
     int m_reserveXY;
@@ -1451,6 +2051,24 @@ class WXDLLIMPEXP_MATHPLOT mpFXYVector: public mpFXY
      */
     double m_minX, m_maxX, m_minY, m_maxY, m_lastX, m_lastY;
 
+    /** Are the X values sorted in ascending order ? Needed to find the points of a X range
+     */
+    bool m_xSorted;
+
+    /** Range min/max of m_ys, built at the first call of GetYRange
+     */
+    mpRangeMinMax m_yRange;
+    bool m_yRangeValid;
+
+    /** Log10 of m_xs and m_ys, computed when first needed by a log axis
+     */
+    std::vector<double> m_logXs, m_logYs;
+    bool m_logXsValid, m_logYsValid;
+
+    /** Compute the log10 copies of the data needed by the log axis, if not already done
+     */
+    void UpdateLogData(bool logX, bool logY);
+
     /** Rewind value enumeration with mpFXY::GetNextXY.
      Overridden in this implementation.
      */
@@ -1466,36 +2084,61 @@ class WXDLLIMPEXP_MATHPLOT mpFXYVector: public mpFXY
      */
     virtual bool GetNextXY(double *x, double *y);
 
+    /** Get the next point with log test, from the cached log10 copies of the data
+     */
+    virtual bool DoGetNextXY(double *x, double *y);
+
+    /** Copy the next values of the data by chunk
+     */
+    virtual size_t GetNextXYs(double *xs, double *ys, size_t n);
+
+    /** Copy the next values by chunk, from the cached log10 copies of the data for a log axis
+     */
+    virtual size_t DoGetNextXYs(double *xs, double *ys, size_t n);
+
+    /** The data, or their cached log10 copies for a log axis
+     */
+    virtual bool GetXYArrays(const double **xs, const double **ys, size_t *count, double *originX, double *originY);
+
+    virtual bool IsXSorted()
+    {
+      return m_xSorted;
+    }
+
     /** Draw the point added if there is in bound
      */
     void DrawAddedPoint(double x, double y);
 
+    /** Draw the added point in the dc. Coordinates are already in pixels.
+     */
+    void DrawAddedPointOnDC(wxDC &dc, wxCoord ix, wxCoord iy, wxCoord ixlast, wxCoord iylast);
+
     /** Returns the actual minimum X data (loaded in SetData).
      */
     virtual double GetMinX()
     {
-      return m_minX;
+      return m_originX + m_minX;
     }
 
     /** Returns the actual minimum Y data (loaded in SetData).
      */
     virtual double GetMinY()
     {
-      return m_minY;
+      return m_originY + m_minY;
     }
 
     /** Returns the actual maximum X data (loaded in SetData).
      */
     virtual double GetMaxX()
     {
-      return m_maxX;
+      return m_originX + m_maxX;
     }
 
     /** Returns the actual maximum Y data (loaded in SetData).
      */
     virtual double GetMaxY()
     {
-      return m_maxY;
+      return m_originY + m_maxY;
     }
 
   DECLARE_DYNAMIC_CLASS(mpFXYVector)
@@ -1524,6 +2167,12 @@ class WXDLLIMPEXP_MATHPLOT mpProfile: public mpFunction
      */
     virtual double GetY(double x) = 0;
 
+    /** Get function values for an array of arguments.
+     The default implementation calls GetY for each argument.
+     @sa mpFX::GetYs
+     */
+    virtual void GetYs(const double *xs, double *ys, size_t n);
+
     /** Layer plot handler.
      This implementation will plot the function in the visible area and
      put a label according to the aligment specified.
@@ -1543,6 +2192,13 @@ class WXDLLIMPEXP_MATHPLOT mpProfile: public mpFunction
 /** @name mpLayer implementations - furniture (scales, ...)
  @{*/
 
+/** A formatted tick label and its extent */
+typedef struct __mpLabel_Type
+{
+    wxString text;          //!< The label
+    wxCoord width, height;  //!< Extent of the label, with the font of the scale
+} mpLabel;
+
 /** Plot layer implementing an abstract scale ruler.
  The scale numbering automatically adjusts to view and zoom factor.
  */
@@ -1674,6 +2330,36 @@ class WXDLLIMPEXP_MATHPLOT mpScale: public mpLayer
 
     wxString FormatLogValue(double n);
 
+    /** Cache of the formatted labels and their extents, reused across the frames while panning and zooming
+     with the same step. The key identifies the tick for the format and the step, for example the index of the tick.
+     */
+    std::unordered_map<wxInt64, mpLabel> m_labelCache;
+    wxString m_labelCacheFormat;  //!< Format of the cached labels
+    double m_labelCacheStep;      //!< Step of the cached labels
+    wxFont m_labelCacheFont;      //!< Font used to measure the cached labels
+
+    /** Clear the label cache if the format, the step or the font have changed.
+     @param format The format, with all the options which change the text of the labels
+     @param step The step between two ticks
+     @return true if the cache has been cleared */
+    bool CheckLabelCache(const wxString &format, double step);
+
+    /** Get a label from the cache.
+     @return NULL if not found */
+    const mpLabel* FindLabel(wxInt64 key) const;
+
+    /** Measure a label and add it to the cache */
+    const mpLabel* AddLabel(wxDC &dc, wxInt64 key, const wxString &text);
+
+    /** Grid lines and ticks of the frame, collected by the plot loop and drawn in a batch with one pen change each
+     */
+    std::vector<wxPoint> m_gridBegin, m_gridEnd;
+    std::vector<wxPoint> m_tickBegin, m_tickEnd;
+
+    /** Draw the collected grid lines, then the ticks, and clear them. The pen of the scale is selected at the end.
+     */
+    void DrawSegments(wxDC &dc);
+
   DECLARE_DYNAMIC_CLASS(mpScale)
 };
 
@@ -1690,6 +2376,48 @@ class WXDLLIMPEXP_MATHPLOT mpScale: public mpLayer
 #define mpX_DATETIME 0x04
 /** Set label user defined */
 #define mpX_USER 0x05
+/** Set label for X axis in timestamp mode: the X values are seconds relative to the time origin of the axis,
+ * an int64 count of nanoseconds since 1970-01-01 (see mpScaleX::SetTimeOrigin). The ticks are aligned on the
+ * calendar (nanoseconds to years) and the labels are formatted down to the nanosecond. */
+#define mpX_TIMESTAMP 0x06
+
+/** Calendar fields of a timestamp */
+typedef struct __mpCalendarTime_Type
+{
+    int year, month, day;      //!< Date, month in [1, 12]
+    int hour, minute, second;  //!< Time of the day
+    int nanosecond;            //!< Fraction of the second in nanoseconds
+} mpCalendarTime;
+
+/**
+ * Conversion between int64 timestamps in nanoseconds since 1970-01-01 and calendar fields.
+ * Only integer arithmetic is used, without call to the C library, so the static methods are thread-safe.
+ * ToCalendar keeps the date of the last converted day, since consecutive ticks are mostly in the same day:
+ * an instance must not be shared between threads without locking.
+ */
+class mpTimeConverter
+{
+  public:
+    mpTimeConverter()
+    {
+      m_day = 0;
+      CivilFromDays(m_day, &m_year, &m_month, &m_dayOfMonth);
+    }
+
+    /** Convert a timestamp in nanoseconds to calendar fields */
+    void ToCalendar(wxInt64 timestamp, mpCalendarTime *time);
+
+    /** Number of days since 1970-01-01 of a date, in the proleptic Gregorian calendar
+     @param month in [1, 12] */
+    static wxInt64 DaysFromCivil(int year, int month, int day);
+
+    /** Date of a number of days since 1970-01-01 */
+    static void CivilFromDays(wxInt64 days, int *year, int *month, int *day);
+
+  private:
+    wxInt64 m_day;                       //!< Last converted day, in days since 1970-01-01
+    int m_year, m_month, m_dayOfMonth;   //!< Date of m_day
+};
 
 /** Plot layer implementing a x-scale ruler.
  The ruler is fixed at Y=0 in the coordinate system. A label is plotted at
@@ -1709,6 +2437,9 @@ class WXDLLIMPEXP_MATHPLOT mpScaleX: public mpScale
     {
       m_labelType = type;
       m_timeConv = mpX_RAWTIME;
+      m_timeOrigin = 0;
+      m_transition = 0;
+      m_transitionBefore = m_transitionAfter = 0;
     }
 
     /** Layer plot handler.
@@ -1751,9 +2482,72 @@ class WXDLLIMPEXP_MATHPLOT mpScaleX: public mpScale
     virtual bool IsLogAxis();
     virtual void SetLogAxis(bool log);
 
+    /** Set the time origin of the mpX_TIMESTAMP mode, in nanoseconds since 1970-01-01.
+     The X values are seconds relative to this origin: choose it near the data, so the double X values
+     are small and keep the precision of the nanoseconds.
+     @sa TimestampToX */
+    void SetTimeOrigin(wxInt64 origin)
+    {
+      m_timeOrigin = origin;
+    }
+
+    /** Get the time origin of the mpX_TIMESTAMP mode
+     @sa SetTimeOrigin */
+    wxInt64 GetTimeOrigin() const
+    {
+      return m_timeOrigin;
+    }
+
+    /** Convert a timestamp in nanoseconds to a X value of the mpX_TIMESTAMP mode.
+     The difference is computed with integers, so it is exact. */
+    double TimestampToX(wxInt64 timestamp) const
+    {
+      return (double)(timestamp - m_timeOrigin) * 1e-9;
+    }
+
+    /** Convert a X value of the mpX_TIMESTAMP mode to a timestamp in nanoseconds */
+    wxInt64 XToTimestamp(double x) const;
+
+    /** Format a timestamp as yyyy-mm-ddThh:mm:ss.uuuuuu, in local time if the time conversion is mpX_LOCALTIME */
+    wxString FormatTimestamp(wxInt64 timestamp);
+
   protected:
     unsigned int m_labelType;  //!< Select labels mode: mpX_NORMAL for normal labels, mpX_TIME for time axis in hours, minutes, seconds
     unsigned int m_timeConv;   //!< Selects if time has to be converted to local time or not.
+    wxInt64 m_timeOrigin;      //!< Time origin of the mpX_TIMESTAMP mode, in nanoseconds since 1970-01-01
+    mpTimeConverter m_timeConverter;  //!< Conversion of the timestamps to calendar fields
+    std::vector<wxInt64> m_timeTicks; //!< Ticks of the mpX_TIMESTAMP mode, in local nanoseconds
+    std::vector<int> m_timeTicksPx;   //!< Position of the ticks of the mpX_TIMESTAMP mode, in pixels
+    wxInt64 m_transition;             //!< Last change of the local offset found, in UTC nanoseconds
+    wxInt64 m_transitionBefore, m_transitionAfter; //!< Local offsets before and after m_transition
+
+    /** Plot the ticks and labels of the mpX_TIMESTAMP mode */
+    void DoPlotTimestamp(wxDC &dc, mpWindow &w, int orgy);
+
+    /** Compute the calendar aligned ticks of the visible range, in local nanoseconds
+     @param minStep Minimum step between two ticks, in nanoseconds
+     @return the step, in nanoseconds (approximate for the months) */
+    wxInt64 GetTimeTicks(wxInt64 start, wxInt64 end, double minStep);
+
+    /** Format the label of a tick, with the precision of the step. The midnight ticks show the date. */
+    wxString FormatTimeTick(wxInt64 tick, wxInt64 step);
+
+    /** Offset of the local time to UTC at the timestamp, in nanoseconds. 0 if the time is not converted to local time. */
+    wxInt64 GetLocalOffset(wxInt64 timestamp);
+
+    /** Find the change of the local offset between start and end (daylight saving time), to the second.
+     The last change found is kept, so a pan around it does not search again.
+     @param before Local offset at start
+     @param after Local offset at end, different from before
+     @return the first UTC timestamp with the offset after */
+    wxInt64 GetOffsetTransition(wxInt64 start, wxInt64 end, wxInt64 before, wxInt64 after);
+
+    /** Add the grid line and the tick at the pixel p to the segments of the frame */
+    void AddGridAndTick(int p, int orgy);
+
+    /** Get the label of the tick n from the cache, or format and measure it
+     @param index Index of the tick, the key in the cache */
+    const mpLabel* GetTickLabel(wxDC &dc, const wxString &fmt, wxInt64 index, double n);
 
     virtual int GetOrigin(mpWindow &w);
     virtual void DrawScaleName(wxDC &dc, mpWindow &w, int origin, int labelSize);
@@ -1780,6 +2574,7 @@ class WXDLLIMPEXP_MATHPLOT mpScaleY: public mpScale
         mpScale(name, flags, grids)
     {
       m_isY2Axis = Y2Axis;
+      m_labelHeight = 0;
     }
 
     /** Layer plot handler.
@@ -1809,6 +2604,7 @@ class WXDLLIMPEXP_MATHPLOT mpScaleY: public mpScale
 
   protected:
     bool m_isY2Axis;
+    wxCoord m_labelHeight;  //!< Height of the labels, measured when the label cache is cleared
 
     virtual int GetOrigin(mpWindow &w);
     virtual void DrawScaleName(wxDC &dc, mpWindow &w, int origin, int labelSize);
@@ -1833,6 +2629,10 @@ class WXDLLIMPEXP_MATHPLOT mpScaleY: public mpScale
 //WX_DECLARE_HASH_MAP( int, mpLayer*, wxIntegerHash, wxIntegerEqual, wxLayerList );
 typedef std::deque<mpLayer*> wxLayerList;
 
+/** Define the type for the index of layers by name (or by class name) inside mpWindow.
+ Layers with the same name are kept in insertion order */
+WX_DECLARE_STRING_HASH_MAP(wxLayerList, wxLayerNameMap);
+
 /**
  * Define an event for when we delete a layer
  * Use like this :
@@ -1841,17 +2641,28 @@ typedef std::deque<mpLayer*> wxLayerList;
  */
 typedef std::function<void(void *Sender, const wxString &classname, bool &cancel)> wxOnDeleteLayer;
 
+/** Bounding box of a layer, cached by mpWindow */
+typedef struct
+{
+    mpFloatRect bound;  //!< The bounding box of the layer (Ymin, Ymax hold the Y2 extent for a Y2 axis layer)
+    bool valid;         //!< The layer has a visible bounding box
+    bool isY2;          //!< The layer use the Y2 axis
+    bool changed;       //!< The layer is in the list of the changed layers
+} mpLayerBBox;
+
+/** Define the type for the cache of the layers bounding box inside mpWindow */
+typedef std::unordered_map<mpLayer*, mpLayerBBox> mpLayerBBoxMap;
+
 /**
  * Class for drawing mouse magnetization
  */
-class mpMagnet
+class mpMagnet: public mpOverlay
 {
   public:
     mpMagnet()
     {
-      m_IsDrawn = false;
       m_rightClick = false;
-      m_IsWasDrawn = false;
+      m_overlayShown = false;
     }
     ~mpMagnet()
     {
@@ -1862,14 +2673,16 @@ class mpMagnet
       m_domain = wxRect(left, top, width, height);
       m_plot_size = wxRect(left, top, width + left, height + top);
     }
-    void Plot(wxClientDC &dc, const wxPoint &mousePos);
-    void ClearPlot(wxClientDC &dc);
-    void UpdatePlot(wxClientDC &dc, const wxPoint &mousePos);
-    void SaveDrawState(void)
+    void Plot(const wxPoint &mousePos);
+    void ClearPlot(void)
+    {
+      m_overlayShown = false;
+    }
+
+    /** The cross follows the mouse (pan operation) */
+    void SetPosition(const wxPoint &mousePos)
     {
-      m_IsWasDrawn = m_IsDrawn;
-      // In any cases, set to false because we erase and repaint all the plot
-      m_IsDrawn = false;
+      m_mousePosition = mousePos;
     }
 
     void SetRightClick(void)
@@ -1877,14 +2690,43 @@ class mpMagnet
       m_rightClick = true;
     }
 
+    virtual void GetOverlayRects(wxDC &dc, mpWindow &w, std::vector<wxRect> &rects);
+    virtual void DrawOverlay(wxDC &dc, mpWindow &w);
+
   private:
     wxRect m_domain;           //!< The area delimited by axis (m_margin.left, m_margin.top, m_plotWidth, m_plotHeight)
     wxRect m_plot_size;        //!< The coordinates for the cross (xmin, xmax), (ymin,ymax)
     wxPoint m_mousePosition;   //!< The last position of the mouse
-    bool m_IsDrawn;            //!< Is that the cross is drawn ?
-    bool m_IsWasDrawn;         //!< Is that the cross was drawn before the OnPaint event ?
     bool m_rightClick;         //!< Is the mouse right click ?
-    void DrawCross(wxClientDC &dc);
+};
+
+/**
+ * Class for drawing the zoom selection rectangle
+ */
+class mpZoomBox: public mpOverlay
+{
+  public:
+    mpZoomBox()
+    {
+      m_overlayShown = false;
+    }
+    ~mpZoomBox()
+    {
+      ;
+    }
+
+    /** Set the selection rectangle, hide the box if the rectangle is empty */
+    void SetBox(const wxRect &box)
+    {
+      m_box = box;
+      m_overlayShown = (m_box.width != 0) && (m_box.height != 0);
+    }
+
+    virtual void GetOverlayRects(wxDC &dc, mpWindow &w, std::vector<wxRect> &rects);
+    virtual void DrawOverlay(wxDC &dc, mpWindow &w);
+
+  private:
+    wxRect m_box;              //!< The selection rectangle
 };
 
 /** Canvas for plotting mpLayer implementations.
@@ -1901,6 +2743,11 @@ class mpMagnet
  - DoubleBuffering (Default=disabled): Can be set with EnableDoubleBuffer
  - Mouse based pan/zoom (Default=enabled): Can be set with EnableMousePanZoom.
 
+ When double buffering is enabled, rendering is deferred: a view change only requests a new frame,
+ which is rendered into the back buffer when the event queue is idle. Consecutive requests (for
+ example a burst of mouse wheel events) are merged into a single render. Meanwhile the paint handler
+ blits the last rendered frame, stretched to the current view if the view has moved.
+
  The mouse commands can be visualized by the user through the popup menu, and are:
  - Mouse Move+CTRL: Pan (Move)
  - Mouse Wheel UP: Zoom in
@@ -1938,6 +2785,38 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
      */
     bool AddLayer(mpLayer *layer, bool refreshDisplay = true);
 
+    /** Add several plot layers to the canvas.
+     The display, the legend and the config window are refreshed only once, after all the layers are added.
+     @param layers The layers to add. The mpLayer objects will get under control of mpWindow.
+     @param refreshDisplay States whether to refresh the display (UpdateAll) after adding the layers.
+     @retval TRUE Success
+     @retval FALSE At least one layer was not added.
+     @sa AddLayer
+     */
+    bool AddLayers(const std::vector<mpLayer*> &layers, bool refreshDisplay = true);
+
+    /** Start a batch of updates. Until the matching EndUpdate, the refresh of the display (UpdateAll),
+     of the legend and of the config window are suspended. Calls can be nested.
+     @sa EndUpdate
+     */
+    void BeginUpdate()
+    {
+      m_updateDepth++;
+    }
+
+    /** End a batch of updates. When the outer batch ends, the suspended refresh are done once.
+     @sa BeginUpdate
+     */
+    void EndUpdate();
+
+    /** Checks if a batch of updates is in progress.
+     @sa BeginUpdate
+     */
+    bool IsUpdating() const
+    {
+      return m_updateDepth > 0;
+    }
+
     /** Remove a plot layer from the canvas.
      @param layer Pointer to layer. The mpLayer object will be destructed using delete.
      @param alsoDeleteObject If set to true, the mpLayer object will be also "deleted", not just removed from the internal list.
@@ -1954,6 +2833,44 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
      */
     void DelAllLayers(bool alsoDeleteObject, bool refreshDisplay = true);
 
+    /** Update the name index after a layer has been renamed. Called by mpLayer::SetName.
+     @param layer Pointer to layer.
+     @param oldName The previous name of the layer.
+     */
+    void UpdateLayerName(mpLayer *layer, const wxString &oldName);
+
+    /** Update the Z-Order lists after the Z index of a layer has changed. Called by mpLayer::SetZIndex.
+     @param layer Pointer to layer.
+     @param oldZIndex The previous Z index of the layer.
+     */
+    void UpdateLayerZIndex(mpLayer *layer, mpLayerZOrder oldZIndex);
+
+    /** Mark the bounding box of a layer as changed. Called by mpLayer::BBoxChanged.
+     The global bounding box is updated with the changed layers only at the next UpdateBBox.
+     @param layer Pointer to layer.
+     */
+    void LayerBBoxChanged(mpLayer *layer);
+
+    /** Add an overlay to the canvas. The overlay is drawn above the plot.
+     @param overlay Pointer to overlay. The mpOverlay object stays under the control of the caller.
+     @param refreshDisplay States whether to refresh the overlays after adding the overlay.
+     @sa mpOverlay
+     */
+    void AddOverlay(mpOverlay *overlay, bool refreshDisplay = true);
+
+    /** Remove an overlay from the canvas. The overlay object is not deleted.
+     @param overlay Pointer to overlay.
+     @param refreshDisplay States whether to refresh the overlays after removing the overlay.
+     */
+    void DelOverlay(mpOverlay *overlay, bool refreshDisplay = true);
+
+    /** Draw again the overlays that have changed.
+     Areas covered by the overlays are restored from the rendered frame, and the overlays are drawn on it.
+     Only the old and new areas of the overlays are copied to the window.
+     Without double buffering, the screen areas under the overlays are saved before drawing and restored to erase them.
+     */
+    void RefreshOverlays();
+
     /** Remove all plot layers.
      @param alsoDeleteObject If set to true, the mpLayer objects will be also "deleted", not just removed from the internal list.
      @param func Select type of plot
@@ -2155,6 +3072,8 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     }
 
     /** Set current view's X and Y position and refresh display.
+     The position is an absolute coordinate, so the view resolution is about 2^-52 of its magnitude,
+     see mpFXYVector::SetDataOrigin.
      @param posX New position that corresponds to the center point of the view.
      @param posY New position that corresponds to the center point of the view.
      */
@@ -2204,6 +3123,22 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
         return (wxCoord)((m_posY - y) * m_scaleY);
     }
 
+    /** Converts an array of graph X coordinates into pixel coordinates, like x2p.
+     The loops are written to be vectorized by the compiler. The pixels are clamped to a safe range,
+     a NaN value gives the lowest pixel.
+     @param xs The X coordinates
+     @param pxs Returns the pixel coordinates
+     @param n Number of coordinates
+     @param log Apply log10 to the coordinates first, for the data not yet transformed
+     @param origin Origin added to the coordinates, see mpFXYVector::SetDataOrigin
+     @sa y2pArray */
+    void x2pArray(const double *xs, wxCoord *pxs, size_t n, bool log = false, double origin = 0) const;
+
+    /** Converts an array of graph Y coordinates into pixel coordinates, like y2p.
+     The Y or Y2 axis is chosen once for the whole array.
+     @sa x2pArray */
+    void y2pArray(const double *ys, wxCoord *pys, size_t n, bool Y2 = false, bool log = false, double origin = 0) const;
+
     /** Enable/disable the double-buffering of the window, eliminating the flicker (default=enabled).
      */
     void EnableDoubleBuffer(const bool enabled)
@@ -2211,6 +3146,33 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
       m_enableDoubleBuffer = enabled;
     }
 
+    /** Get the back buffer holding the last rendered frame.
+     Layers that draw incrementally outside OnPaint (like mpFXYVector::AddData) can draw into it
+     to keep the frame up to date.
+     @return The bitmap, or NULL if double buffering is disabled or the frame is out of date */
+    wxBitmap* GetFrameBuffer()
+    {
+      if (m_enableDoubleBuffer && !m_renderPending)
+        return m_buff_bmp;
+      return NULL;
+    }
+
+    /** Enable/disable the zoom preview (default=enabled).
+     When enabled with double buffering, a zoom operation immediately shows the last frame
+     stretched to the new view, until the new frame is rendered.
+     */
+    void EnableZoomPreview(const bool enabled)
+    {
+      m_enableZoomPreview = enabled;
+    }
+
+    /** Get the zoom preview status
+     */
+    bool GetZoomPreview() const
+    {
+      return m_enableZoomPreview;
+    }
+
     /** Enable/disable the feature of pan/zoom with the mouse (default=enabled)
      */
     void EnableMousePanZoom(const bool enabled)
@@ -2287,6 +3249,12 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     /** Refresh display */
     void UpdateAll();
 
+    /** Mark the current frame as out of date and repaint.
+     Call this instead of Refresh() after changing the content of a layer (pen, symbol, data...)
+     without changing the view. With double buffering, Refresh() alone only blits the last frame.
+     The new frame is rendered at idle time. */
+    void InvalidateFrame();
+
     // Added methods by Davide Rondini
 
     /** Counts the number of plot layers, including axes: this is to count only the layers which have a bounding box.
@@ -2564,6 +3532,52 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
       m_LogYaxis = log;
     }
 
+    /** Enable/disable the automatic scale of the Y axis (and Y2 axis) to the visible X range.
+     When enabled, the Y extent of the series is computed on each pan or zoom for the visible X values only.
+     Only the series which support mpFunction::GetYRange are used (mpFXYVector).
+     */
+    void SetAutoScaleYVisible(bool enable)
+    {
+      m_autoScaleYVisible = enable;
+    }
+
+    /** Get the automatic scale of the Y axis to the visible X range status
+     */
+    bool GetAutoScaleYVisible() const
+    {
+      return m_autoScaleYVisible;
+    }
+
+    /** Enable/disable the automatic range of the axis for streaming series.
+     When the bounding box of the layers grows out of the view, the view is expanded with a headroom,
+     so that a full re-fit happens only when the data has grown by this fraction. The view contracts
+     only when the data occupies less than the hysteresis fraction of the view.
+     @param enable Enable the automatic range
+     @param headroom Fraction of the data range added to the side that overflows (default 25%)
+     @param hysteresis Fraction of the view under which the view contracts. Must be less than 1/(1+headroom).
+     Zero never contracts.
+     */
+    void SetAutoRange(bool enable, double headroom = 0.25, double hysteresis = 0.5)
+    {
+      m_autoRange = enable;
+      m_autoRangeHeadroom = headroom;
+      m_autoRangeHysteresis = hysteresis;
+      m_autoRangeBoundValid = false;
+    }
+
+    /** Get the automatic range status
+     */
+    bool GetAutoRange() const
+    {
+      return m_autoRange;
+    }
+
+    /** Adjust the view with the automatic range if the bounding box of the layers has grown out of it.
+     Used by the series when data are added (see mpFXYVector::AddData).
+     @return true if the view has been changed and a full update requested
+     */
+    bool CheckAutoRange();
+
     bool GetMagnetize() const
     {
       return m_magnetize;
@@ -2572,6 +3586,8 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     void SetMagnetize(bool mag)
     {
       m_magnetize = mag;
+      if (!mag)
+        m_magnet.ClearPlot();
     }
 
     void RefreshConfigWindow();
@@ -2586,6 +3602,7 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
   protected:
     void OnPaint(wxPaintEvent &event);                    //!< Paint handler, will plot all attached layers
     void OnSize(wxSizeEvent &event);                      //!< Size handler, will update scroll bar sizes
+    void OnIdle(wxIdleEvent &event);                      //!< Idle handler, will render the pending frame
     void OnShowPopupMenu(wxMouseEvent &event);            //!< Mouse handler, will show context menu
     void OnCenter(wxCommandEvent &event);                 //!< Context menu handler
     void OnFit(wxCommandEvent &event);                    //!< Context menu handler
@@ -2602,6 +3619,7 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     void OnMouseLeftDown(wxMouseEvent &event);            //!< Mouse left click (for rect zoom)
     void OnMouseRightDown(wxMouseEvent &event); //!< Mouse handler, for detecting when the user drags with the right button or just "clicks" for the menu
     void OnMouseMove(wxMouseEvent &event);                //!< Mouse handler for mouse motion (for pan)
+    void ProcessMouseMotion(wxMouseEvent &event);         //!< Process the last mouse motion (info coords, zoom box, magnet)
     void OnMouseLeftRelease(wxMouseEvent &event);         //!< Mouse left click (for rect zoom)
     void OnMouseWheel(wxMouseEvent &event);               //!< Mouse handler for the wheel
     void OnMouseLeave(wxMouseEvent &event);               //!< Mouse handler for mouse motion (for pan)
@@ -2622,10 +3640,64 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
 
     void Zoom(bool zoomIn, const wxPoint &centerPoint);
 
+    /** Draw the background and all the layers in Z order on the given device context */
+    void DrawAll(wxDC &dc);
+
+    /** Render a new frame in the back buffer with the current view */
+    void RenderFrame();
+
+    /** Copy the last rendered frame on the device context.
+     If the view has changed since the frame was rendered, the plot area of the frame is stretched to match the
+     current view, the margins with the axis are copied unchanged.
+     When the Y and Y2 axis would need a different stretch, the frame is copied unchanged until the new one is rendered. */
+    void BlitFrame(wxDC &dc);
+
+    /** Paint immediately, without waiting for the idle render: the paint handler shows the last frame stretched
+     to the current view. Used by zoom operations, the real frame replaces the preview when it is rendered. */
+    void ZoomPreview();
+
+    /** Add the layer to the Z-Order lists and the name indexes */
+    void IndexLayer(mpLayer *layer);
+
+    /** Remove the layer from the Z-Order lists and the name indexes */
+    void UnindexLayer(mpLayer *layer);
+
+    /** Build the list of the overlays : zoom box, info coordinates, magnet and the added overlays */
+    void CollectOverlays();
+
+    /** Draw all the overlays on the device context, which holds a complete frame */
+    void DrawOverlays(wxDC &dc);
+
+    /** Without double buffering, save the screen areas that the overlays will cover */
+    void SaveOverlayAreas(wxDC &dc);
+
     /** Recalculate global layer bounding box, and save it in m_minX,...
+     * Only the layers whose bounding box has changed are queried, unless fullRecompute is set.
+     * \param fullRecompute query the bounding box of all the layers
      * \return true if there is any valid BBox information.
      */
-    virtual bool UpdateBBox();
+    virtual bool UpdateBBox(bool fullRecompute = false);
+
+    /** Query the bounding box of the layer and store it in the cache entry */
+    void QueryLayerBBox(mpLayer *layer, mpLayerBBox &bbox);
+
+    /** Update the global bounding box of the layers with the change of one layer, from oldBBox to newBBox.
+     The axis for which the global bounding box can shrink are marked to be recomputed. */
+    void ApplyLayerBBox(const mpLayerBBox &oldBBox, const mpLayerBBox &newBBox);
+
+    /** Remove the layer from the bounding box cache */
+    void RemoveLayerBBox(mpLayer *layer);
+
+    /** Scale the Y and Y2 axis to the extent of the series in the visible X range */
+    void AutoScaleYVisible();
+
+    /** Apply the automatic range to the view if the bounding box of the layers has changed.
+     @return true if the view has been changed */
+    bool AutoRange();
+
+    /** Expand or contract one axis range [vmin, vmax] of the view to the data range [dmin, dmax].
+     @return true if the range has been changed */
+    bool AutoRangeAxis(double dmin, double dmax, double &vmin, double &vmax);
 
     void InitParameters();
 
@@ -2633,6 +3705,27 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     bool m_fullscreen;
 
     wxLayerList m_layers;   //!< List of attached plot layers
+    wxLayerList m_layersZ[mpZIndex_END];  //!< Attached plot layers sorted by Z index, in insertion order
+    wxLayerNameMap m_layersByName;        //!< Attached plot layers by name
+    wxLayerNameMap m_layersByClass;       //!< Attached plot layers by class name
+
+    mpLayerBBoxMap m_layersBBox;          //!< Cache of the bounding box of the attached layers
+    std::vector<mpLayer*> m_layersBBoxChanged; //!< Layers whose bounding box has changed since the last UpdateBBox
+    mpFloatRect m_layersBound;            //!< Global bounding box of the layers, before axis and log adjustments
+    bool m_layersBoundValid[3];           //!< Is m_layersBound valid for X, Y and Y2
+    bool m_layersBoundDirty[3];           //!< Must m_layersBound be recomputed for X, Y and Y2
+
+    bool m_autoScaleYVisible;             //!< Scale the Y axis on the visible X range
+    bool m_autoRange;                     //!< Automatic range of the axis for streaming series
+    double m_autoRangeHeadroom;           //!< Fraction of the data range added when the view expands
+    double m_autoRangeHysteresis;         //!< Fraction of the view under which the view contracts
+    mpFloatRect m_autoRangeBound;         //!< Bounding box when the automatic range was last applied
+    bool m_autoRangeBoundValid;           //!< Is m_autoRangeBound valid
+
+    int m_updateDepth;                    //!< Nesting level of BeginUpdate
+    bool m_updatePendingAll;              //!< UpdateAll was requested during the batch
+    bool m_updatePendingLegend;           //!< The legend must be updated at the end of the batch
+    bool m_updatePendingConfig;           //!< The config window must be refreshed at the end of the batch
     mpScaleX* m_XAxis;      //!< Pointer to the X axis layer
     mpScaleY* m_YAxis;      //!< Pointer to the Y axis layer
     mpScaleY* m_Y2Axis;     //!< Pointer to the Y2 axis layer
@@ -2672,6 +3765,16 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     int m_last_lx, m_last_ly;           //!< For double buffering
     wxBitmap* m_buff_bmp;               //!< For double buffering
     bool m_enableDoubleBuffer;          //!< For double buffering. Default enabled
+    bool m_renderPending;               //!< A new frame is requested, it will be rendered on idle
+    bool m_enableZoomPreview;           //!< For show the stretched last frame while zooming
+    wxMouseEvent m_motionEvent;         //!< Last mouse motion event not yet processed
+    bool m_motionPending;               //!< A mouse motion is waiting to be processed on idle
+    double m_frame_posX;                //!< View's X position of the rendered frame
+    double m_frame_posY;                //!< View's Y position of the rendered frame
+    double m_frame_scaleX;              //!< View's X scale of the rendered frame
+    double m_frame_scaleY;              //!< View's Y scale of the rendered frame
+    double m_frame_posY2;               //!< View's Y2 position of the rendered frame
+    double m_frame_scaleY2;             //!< View's Y2 scale of the rendered frame
     bool m_enableMouseNavigation;       //!< For pan/zoom with the mouse.
     bool m_mouseMovedAfterRightClick;
     wxPoint m_mouseRClick;              //!< For the right button "drag" feature
@@ -2681,13 +3784,18 @@ class WXDLLIMPEXP_MATHPLOT mpWindow: public wxWindow
     mpInfoLayer* m_movingInfoLayer;     //!< For moving info layers over the window area
     mpInfoCoords* m_InfoCoords;         //!< Shortcut to info coords layer
 
-    wxBitmap* m_zoom_bmp;               //!< For zoom selection
-    wxRect m_zoom_dim;
-    wxRect m_zoom_oldDim;
+    mpZoomBox m_zoomBox;                //!< For zoom selection
 
     bool m_magnetize;                   //!< For mouse magnetization
     mpMagnet m_magnet;                  //!< For mouse magnetization
 
+    std::vector<mpOverlay*> m_overlays;        //!< The overlays added with AddOverlay
+    std::vector<mpOverlay*> m_overlayList;     //!< All the overlays to draw, rebuilt on each refresh
+    std::vector<wxRect> m_overlayDrawn;        //!< The areas of the overlays drawn on the window
+    std::vector<wxRect> m_overlayRects;        //!< The new areas of the overlays
+    mpBackingStore m_overlay_store;            //!< Scratch surface where the overlays are composed
+    std::deque<mpBackingStore> m_screen_stores; //!< Without double buffer, the screen areas under the overlays
+
     bool m_LogXaxis = false;            //!< For logarithmic X axis
     bool m_LogYaxis = false;            //!< For logarithmic X axis
 